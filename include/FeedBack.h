@@ -22,7 +22,8 @@
  * Defines some of the constants associated with the FeedBack charting program.
  */
 
-// Time durations
+// Time durations at FeedBack's default resolution of 192 ticks per beat.
+// Charts may use any resolution, see timing.h.
 static const unsigned int DURATION_1_1 = 768; // One measure
 static const unsigned int DURATION_1_2 = DURATION_1_1 / 2; // 1/2 a measure
 static const unsigned int DURATION_1_3 = DURATION_1_1 / 3; // etc..
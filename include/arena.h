@@ -0,0 +1,58 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * A bump allocator. Allocations are carved out of large blocks and are never
+ * freed individually; `reset` releases all of them at once and keeps the
+ * blocks, so an arena that is reset between charts stops allocating once it
+ * has grown to fit the largest of them.
+ */
+class Arena {
+public:
+    Arena();
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /** Allocate `size` bytes aligned to `align`, which must be a power of two */
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+    /** Release every allocation. The memory is kept for reuse. */
+    void reset();
+    /** Release every allocation and return the memory to the system */
+    void release();
+    void swap(Arena& other);
+    /** Total size of the blocks held by the arena */
+    size_t capacity() const;
+private:
+    static const size_t MIN_BLOCK_SIZE = 4096;
+
+    struct Block {
+        char* data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    /** The block currently being filled */
+    size_t current;
+    /** Bytes used in the current block */
+    size_t used;
+};
@@ -0,0 +1,74 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+#include "chart.h"
+
+/**
+ * A binary copy of a parsed chart, kept next to the .chart file so that
+ * unchanged charts do not have to be parsed again. The file starts with a
+ * `cache::Header`, followed by the song metadata, the string pool, the sync
+ * track and events, the sections that are kept as they are, and one block of
+ * notes and track events per note track.
+ * Events are stored exactly as they are laid out in memory.
+ *
+ * A cache is only used if it was written by the same format version from a
+ * source file with the same size and contents, and its payload matches the
+ * hash in the header. The source is hashed rather than compared by
+ * modification time, which misses edits within the same second and tools
+ * that keep the time. Values are stored in native byte order; a
+ * cache written on a machine with a different byte order fails the magic
+ * check and is simply rebuilt.
+ */
+namespace cache {
+
+    const uint32_t MAGIC = 0x31425443; // "CTB1"
+    /** Increment whenever the layout of the header or payload changes */
+    const uint32_t VERSION = 4;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        /** Size and FNV-1a hash of the .chart file the cache was built from */
+        uint64_t sourceSize;
+        uint64_t sourceHash;
+        uint64_t payloadSize;
+        /** FNV-1a hash of the payload */
+        uint64_t payloadHash;
+    };
+
+    /**
+     * The cache file for a chart, e.g. "song.ctb" for "song.chart".
+     */
+    std::string path(const std::string& chartPath);
+    /**
+     * Fill `chart` from the cache of `chartPath`. Returns false, leaving
+     * `chart` untouched, if there is no valid, up to date cache. Every note
+     * track is loaded, so this is only used when none are selected.
+     */
+    bool load(Chart& chart, const std::string& chartPath);
+    /**
+     * Write the cache of `chartPath`. `chart` must hold every section of the
+     * file, parsed and not yet fixed.
+     */
+    bool save(const Chart& chart, const std::string& chartPath);
+}
@@ -18,21 +18,216 @@
  */
 #pragma once
 
+#include <array>
+#include <bitset>
 #include <map>
-#include <unordered_map>
-#include <set>
+#include <memory>
 #include <vector>
 
+#include "diag.h"
 #include "event.h"
+#include "eventlist.h"
+#include "notecolumn.h"
+#include "patch.h"
+#include "stringpool.h"
+#include "strview.h"
+#include "timeline.h"
+#include "track.h"
+#include "writer.h"
 
+#define SONG_SECTION "Song"
+#define SYNC_TRACK_SECTION "SyncTrack"
+#define EVENTS_SECTION "Events"
+
+class MappedFile;
+
+/**
+ * The location of a `[Section] { ... }` block within the chart file.
+ */
+struct ChartSection {
+    std::string name;
+    /** The note track this section holds, invalid for other sections */
+    TrackId track;
+    /** Byte offsets of the section body, between the braces */
+    size_t begin;
+    size_t end;
+    bool loaded;
+};
+
+/**
+ * A section that is not understood, e.g. [ExpertGHLGuitar], or a note track
+ * that is not selected, kept as it was read so that writing the chart does
+ * not lose it.
+ */
+struct RawSection {
+    std::string name;
+    /** The lines between the braces, with their line endings */
+    std::string body;
+};
+
+/** Outcome of `Chart::write` */
+enum WriteResult {
+    WRITE_FAILED,
+    WRITE_WRITTEN,
+    /** The file already held exactly the output, so it was left alone */
+    WRITE_UNCHANGED
+};
+
+/**
+ * A track event text that charters use in place of a note flag, since
+ * FeedBack cannot load charts with the flag itself. See `fix::setNoteFlags`.
+ */
+struct NoteFlagMarker {
+    NoteFlagMarker(const std::string& text, unsigned int flag, bool replacesLanes = false) :
+        text(text), flag(flag), replacesLanes(replacesLanes) {}
+    std::string text;
+    /** The flag bit the marker stands for, see NOTE_FLAG_VAL_* */
+    unsigned int flag;
+    /**
+     * The flag takes the place of the lanes of the marked note, as an open
+     * note does. The note is given a green lane when the flag is unset.
+     */
+    bool replacesLanes;
+};
+
+/**
+ * A note track, e.g. [ExpertSingle].
+ */
+struct NoteTrack {
+    NoteTrack() : present(false), retimed(0) {}
+    /** Remove every note and event, keeping the memory for reuse */
+    void clear();
+    /** Apply the steps of `timeline` that have not been applied yet */
+    void settle(const Timeline& timeline);
+    /** True if the track appears in the chart */
+    bool present;
+    /** Playable notes and note flags, i.e. anything starting with "N" in a note track */
+    NoteColumn notes;
+    /** Everything else that appears in a note track: star power and track events */
+    EventList events;
+    /**
+     * Number of steps of `Chart::timeline` already applied to the ticks of
+     * `notes` and `events`. The rest map them to chart ticks.
+     */
+    size_t retimed;
+};
+
+/**
+ * The note tracks of a chart, indexed by `TrackId::index()`. Copies share
+ * each track until it is modified: non-const access to a track that another
+ * copy still refers to copies that track first. A copy of a chart therefore
+ * duplicates only the tracks that are later changed in one of the copies.
+ *
+ * Read through a const reference to avoid unsharing a track needlessly.
+ */
+class NoteTracks {
+public:
+    template <typename Tracks, typename Track>
+    class Iterator {
+    public:
+        Iterator(Tracks* tracks, size_t i) : tracks(tracks), i(i) {}
+        Track& operator*() const { return (*tracks)[i]; }
+        Iterator& operator++() { i++; return *this; }
+        bool operator==(const Iterator& other) const { return i == other.i; }
+        bool operator!=(const Iterator& other) const { return i != other.i; }
+    private:
+        Tracks* tracks;
+        size_t i;
+    };
+    typedef Iterator<NoteTracks, NoteTrack> iterator;
+    typedef Iterator<const NoteTracks, const NoteTrack> const_iterator;
+
+    NoteTracks();
+    size_t size() const { return TrackId::COUNT; }
+    const NoteTrack& operator[](size_t i) const { return *tracks[i]; }
+    /** Read track `i` without unsharing it, even through a non-const reference */
+    const NoteTrack& get(size_t i) const { return *tracks[i]; }
+    /** Access track `i` for modification, copying it first if it is shared */
+    NoteTrack& operator[](size_t i);
+    /** True if another copy still refers to track `i` */
+    bool shared(size_t i) const { return tracks[i].use_count() > 1; }
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, TrackId::COUNT); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, TrackId::COUNT); }
+    /** Clear every track, dropping shared ones rather than copying them */
+    void clear();
+    void swap(NoteTracks& other) { tracks.swap(other.tracks); }
+private:
+    std::array<std::shared_ptr<NoteTrack>, TrackId::COUNT> tracks;
+};
+
+/**
+ * A parsed chart. Copying a chart is a cheap snapshot: the note tracks are
+ * shared until modified (see `NoteTracks`), so several variants can be
+ * fixed and written from one parse.
+ */
 class Chart {
 public:
     Chart();
     ~Chart();
+    /**
+     * Forget the chart that was read, keeping the settings and the memory of
+     * every container so that the next chart can be read into this one with
+     * few allocations.
+     */
+    void clear();
     bool read(std::string fpath);
     bool read(std::istream& in);
-    bool write(std::string fpath);
+    /**
+     * Parse chart text held in memory. `text` only needs to stay valid for
+     * the duration of the call, so every selected section is parsed
+     * immediately regardless of `lazy`.
+     */
+    bool parse(StrView text);
+    /**
+     * Parse a note section that was deferred by `lazy`. Does nothing if the
+     * section has already been parsed.
+     */
+    bool load(TrackId track);
+    /**
+     * Parse every selected section that has not been parsed yet.
+     */
+    bool loadAll();
+    /**
+     * Access a note track, parsing it first if it was deferred.
+     */
+    NoteTrack& track(TrackId track);
+    /**
+     * Parse the body of a single section, i.e. the lines between its braces,
+     * into the chart.
+     */
+    bool parseSection(const std::string& section, StrView body);
+    /**
+     * True if `track` is invalid (not a note track), or is one of the
+     * `selectedTracks`.
+     */
+    bool isSelected(TrackId track) const;
+    /** Add a section to `rawSections`, to be written back unchanged */
+    void keepSection(const std::string& section, StrView body);
+    /**
+     * Write the chart to the file at `fpath`, or to stdout if it is "-". A
+     * file is replaced atomically, and not touched at all if it already
+     * holds exactly this chart. See `Writer`.
+     */
+    WriteResult write(std::string fpath);
+    /**
+     * Write `edits` as a patch to the file at `fpath`, or to stdout if it is
+     * "-", in the same way as `write`.
+     */
+    WriteResult writePatch(std::string fpath);
     std::string toString();
+    /** Write every section, in the order they appear in a chart file */
+    void writeSections(Writer& out);
+    void writeSongSection(Writer& out);
+    void writeSyncTrackSection(Writer& out);
+    void writeEventsSection(Writer& out);
+    void writeNoteSection(Writer& out, TrackId track);
+    /**
+     * Write every section in `rawSections`, unchanged unless it is a note
+     * track and `timeline` has moved the rest of the chart
+     */
+    void writeRawSections(Writer& out);
 
     // [Song]
     std::string name;
@@ -48,27 +243,100 @@ public:
     std::string mediaType;
     std::string musicStream;
     // [SyncTrack]
-    std::vector<SyncTrackEvent> syncTrack;
+    EventList syncTrack;
     // [Events]
-    std::vector<Event> events;
-    // Note tracks, e.g. [ExpertSingle]
-    /** Playable notes and note flags, i.e. anything starting with "N" in a note track */
-    std::unordered_map<std::string, std::map<uint32_t, Note>> noteTrackNotes;
-    /** Everything else that appears in a note track: star power and track events */
-    std::unordered_map<std::string, std::vector<NoteTrackEvent>> noteTrackEvents;
-    
-    std::string track_event_tap;
-    std::string track_event_hopo_flip;
+    EventList events;
+    /** Text of every event in the chart, see `Event::text` */
+    StringPool strings;
+    // Note tracks, e.g. [ExpertSingle], indexed by `TrackId::index()`
+    NoteTracks noteTracks;
+    /** Every section block found in the file, in file order */
+    std::vector<ChartSection> sections;
+    /**
+     * Sections that are not understood and note tracks that are not
+     * selected, in file order, written after the note tracks
+     */
+    std::vector<RawSection> rawSections;
+
+    /** Note tracks to parse, by `TrackId::index()`. If none are set, all tracks are parsed. */
+    std::bitset<TrackId::COUNT> selectedTracks;
+    /** Defer parsing note tracks until they are first accessed */
+    bool lazy;
+    /**
+     * Number of threads used to parse, fix and write note tracks. 1 does all
+     * of the work on the calling thread.
+     */
+    unsigned int threads;
+    /**
+     * Read from the binary cache next to the chart file when it is up to
+     * date, and write it after parsing otherwise. See cache.h.
+     */
+    bool useCache;
+    /**
+     * Changes to the ticks of every note track, applied to a track only when
+     * it is modified (see `NoteTrack::settle`) and otherwise as it is
+     * written. Moving all of the notes of a chart costs nothing until then.
+     * [SyncTrack] and [Events] are small and are changed directly instead.
+     */
+    Timeline timeline;
+    /** Diagnostics raised while reading and fixing the chart */
+    diag::Log log;
+    /** Edits made by the fixes, recorded if `edits.enabled` is set */
+    patch::EditList edits;
+
+    /**
+     * Track event markers converted to and from note flags. The first marker
+     * for a text or a flag wins.
+     */
+    std::vector<NoteFlagMarker> noteFlagMarkers;
+    /** Minimum gap after a sustain in ticks, 0 for `sustainGap()`'s default */
     unsigned int min_sustain_gap;
+    /** `min_sustain_gap`, or a 32nd note at the chart's resolution if it is 0 */
+    unsigned int sustainGap() const;
+    /**
+     * Intern the text of an event at `tick` into `strings`. Returns false,
+     * with an error in `log`, if the id does not fit in `Event::text`; the
+     * event must then be dropped rather than take another string's text.
+     */
+    static bool internEventText(StringPool& strings, StrView text, uint32_t& id, diag::Log& log,
+            TrackId track, uint32_t tick);
 private:
-    bool parseSongLine(const std::string& line);
-    bool parseSyncTrackLine(const std::string& line);
-    bool parseEventsLine(const std::string& line);
-    bool parseNoteSectionLine(const std::string& section, const std::string& line);
-    bool extractNotesFromNoteTrackEvents();
+    /** Rough size of the chart as text, used to size output buffers */
+    size_t estimateSize() const;
+    static size_t estimateSize(const NoteTrack& track);
+    /** Write the lines of a note section, mapping its ticks through `timeline` */
+    void writeNoteLines(Writer& out, const NoteTrack& track, const Timeline& timeline) const;
+    bool readFile(std::shared_ptr<MappedFile> file);
+    /**
+     * Record the byte range of every section block without parsing it.
+     */
+    bool index(StrView text);
+    /**
+     * Parse every selected section that has not been parsed yet, optionally
+     * leaving note sections for later.
+     */
+    bool parseSections(StrView text, bool deferNoteSections);
     /**
-     * Merge std::vector<NoteTrackEvent> and std::map<uint32_t, Note> into
-     * a single std::vector<NoteTrackEvent>, converting all Note objects.
+     * Parse a note section into the given containers. Touches no other state,
+     * so separate note sections may be parsed concurrently.
      */
-    void mergeEvents(std::vector<NoteTrackEvent>& out, const std::vector<NoteTrackEvent>& nte, const std::map<uint32_t, Note>& notes);
+    static bool parseNoteSection(StrView body, TrackId id, NoteTrack& track, StringPool& strings,
+            diag::Log& log);
+    /**
+     * Add a note section parsed by `parseNoteSection` to the chart, moving its
+     * event text from `parsedStrings` into `strings`.
+     */
+    void mergeNoteSection(TrackId id, NoteTrack& parsed, const StringPool& parsedStrings);
+    bool parseSongLine(StrView line);
+    bool parseSyncTrackLine(StrView line);
+    bool parseEventsLine(StrView line);
+    /**
+     * Parse one line of a note section. A note earlier than the last one in
+     * `notes` is added to `late` instead, to be inserted in one batch.
+     */
+    static bool parseNoteSectionLine(NoteColumn& notes, std::vector<Note>& late, EventList& events,
+            StrView line, TrackId id, StringPool& strings, diag::Log& log);
+
+    /** The file being parsed, kept open while any section is deferred */
+    std::shared_ptr<MappedFile> source;
 };
@@ -0,0 +1,111 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "track.h"
+
+/**
+ * Debug records are only compiled in when DEBUG_PRINT is defined.
+ */
+#ifdef DEBUG_PRINT
+#define DIAG_COMPILED_SEVERITY diag::SEVERITY_DEBUG
+#else
+#define DIAG_COMPILED_SEVERITY diag::SEVERITY_INFO
+#endif
+
+/**
+ * Add a record to the diag::Log `LOG`. `X` is a stream expression, e.g.
+ * "Inserted end event at time " << time, and is only evaluated if the record
+ * is kept.
+ */
+#define DIAG(LOG, SEVERITY, CODE, TRACK, TICK, X) do { \
+        if ((SEVERITY) >= DIAG_COMPILED_SEVERITY && (LOG).enabled(SEVERITY)) { \
+            std::ostringstream diag_ss_; \
+            diag_ss_ << X; \
+            (LOG).add((SEVERITY), (CODE), (TRACK), (TICK), diag_ss_.str()); \
+        } \
+    } while (0)
+
+namespace diag {
+
+    enum Severity {
+        SEVERITY_DEBUG,
+        SEVERITY_INFO,
+        SEVERITY_WARNING,
+        SEVERITY_ERROR
+    };
+
+    enum Format {
+        FORMAT_TEXT,
+        /** One JSON object per line */
+        FORMAT_JSON
+    };
+
+    /** Tick value for records that do not refer to a point in a track */
+    const uint32_t NO_TICK = 0xFFFFFFFF;
+
+    struct Record {
+        Severity severity;
+        /** Short, stable identifier of the kind of record, e.g. "sustain-gap" */
+        const char* code;
+        /** Invalid if the record is not about a single note track */
+        TrackId track;
+        uint32_t tick;
+        std::string message;
+    };
+
+    /**
+     * Diagnostics for one chart file. Records are buffered until `flush` so
+     * that they can be written in one go, and in a deterministic order when
+     * parts of the chart are processed concurrently.
+     */
+    class Log {
+    public:
+        Log();
+        bool enabled(Severity severity) const { return severity >= minSeverity; }
+        void add(Severity severity, const char* code, TrackId track, uint32_t tick,
+                const std::string& message);
+        /**
+         * Move every record of `other` onto the end of this log.
+         */
+        void append(Log& other);
+        /**
+         * Write all buffered records to `out` and clear them.
+         */
+        void flush(std::ostream& out, Format format);
+
+        /** The chart file the records are about, "-" for stdin */
+        std::string file;
+        /** Records below this severity are discarded */
+        Severity minSeverity;
+        std::vector<Record> records;
+    };
+
+    const char* severityName(Severity severity);
+    /**
+     * Parse a severity name as returned by `severityName`. Returns false if
+     * `name` is not one.
+     */
+    bool parseSeverity(const std::string& name, Severity& severity);
+}
@@ -21,9 +21,14 @@
 #include <string>
 #include <stdint.h>
 #include <map>
+#include <type_traits>
 #include <vector>
 #include <iostream>
 
+#include "stringpool.h"
+#include "strview.h"
+#include "writer.h"
+
 const unsigned int NOTE_FLAG_VAL_GREEN = 0;
 const unsigned int NOTE_FLAG_VAL_RED = 1;
 const unsigned int NOTE_FLAG_VAL_YELLOW = 2;
@@ -33,82 +38,101 @@ const unsigned int NOTE_FLAG_VAL_HOPO_FLIP = 5;
 const unsigned int NOTE_FLAG_VAL_TAP = 6;
 const unsigned int NOTE_FLAG_VAL_OPEN = 7;
 const unsigned int NOTE_FLAG_TOTAL = 8;
+/** Number of string ids that fit in `Event::text` */
+const uint32_t EVENT_TEXT_IDS = 1u << 24;
+/** The bits of the five lanes, green to orange */
+const unsigned int NOTE_LANE_MASK = 0x1F;
 
-const std::string NOTE_TRACK_EVENT_TYPE_EVENT = "E";
-const std::string NOTE_TRACK_EVENT_TYPE_STAR_POWER = "S";
-const std::string NOTE_TRACK_EVENT_TYPE_NOTE = "N";
-
-const std::string SYNC_TRACK_EVENT_TYPE_TEMPO = "B";
-const std::string SYNC_TRACK_EVENT_TYPE_TIMESIG = "TS";
-
-class Event {
-public:
-    Event(uint32_t time, std::string text);
-    Event(uint32_t time, std::string type, std::string text);
-    ~Event();
-    /**
-     * Return the string representation of this event as it would appear in a
-     * chart file. Subclasses of `Event` should use this method to allow for
-     * easy serialisation.
-     */
-    virtual std::string toEventString() const;
-    friend bool operator<(const Event& e0, const Event& e1);
+/**
+ * The type of an event line, e.g. the "B" in "768 = B 120000". Types are
+ * declared in the alphabetical order of their names so that events sort as
+ * they did when the type was a string.
+ */
+enum EventType {
+    /** "A": tempo anchor, in the sync track */
+    EVENT_TYPE_ANCHOR,
+    /** "B": tempo change, BPM * 1000 */
+    EVENT_TYPE_TEMPO,
+    /** "E": text event, in [Events] or a note track */
+    EVENT_TYPE_TEXT,
+    /** "N": a single note or note flag */
+    EVENT_TYPE_NOTE,
+    /** "S": star power phrase */
+    EVENT_TYPE_STAR_POWER,
+    /** "TS": time signature change */
+    EVENT_TYPE_TIMESIG,
+    /** Any other sync track event, whose type name is held in `Event::text` */
+    EVENT_TYPE_OTHER,
+    EVENT_TYPE_COUNT
+};
 
-    uint32_t time;
-    /**
-     * The "E" in the event string
-     */
-    std::string type;
-    /**
-     * The text that appears after the "E " in the event
-     */
-    std::string text;
+/** Event type names, indexed by `EventType` */
+static const char* const EVENT_TYPE_NAMES[EVENT_TYPE_COUNT] = {
+    "A", "B", "E", "N", "S", "TS", ""
 };
 
-class SyncTrackEvent : public Event {
-public:
-    SyncTrackEvent(uint32_t time, std::string type, uint32_t value);
-    ~SyncTrackEvent();
-    std::string toEventString() const override;
-    bool isTsChange() const;
-    bool isTempoChange() const;
+/**
+ * Resolve an event type name. Unknown names give EVENT_TYPE_OTHER.
+ */
+EventType eventTypeFromName(StrView name);
 
-    friend bool operator<(const SyncTrackEvent& e0, const SyncTrackEvent& e1);
+/**
+ * A single event line from any section. Events are plain values: they can be
+ * copied and sorted bytewise, and any text lives in the chart's `StringPool`.
+ */
+struct Event {
+    Event() = default;
+    Event(uint32_t time, EventType type, uint32_t value, uint32_t duration = 0) :
+        time(time), value(value), duration(duration), text(0), type(type) {}
+    /** An "E" event with the interned text `text` */
+    static Event makeText(uint32_t time, uint32_t text);
 
-    uint32_t value;
-};
+    bool isEvent() const { return type == EVENT_TYPE_TEXT; }
+    bool isNote() const { return type == EVENT_TYPE_NOTE; }
+    bool isFlag() const { return isNote() && value > NOTE_FLAG_VAL_ORANGE; }
+    bool isStarPower() const { return type == EVENT_TYPE_STAR_POWER; }
+    bool isTempoChange() const { return type == EVENT_TYPE_TEMPO; }
+    bool isTsChange() const { return type == EVENT_TYPE_TIMESIG; }
 
-class NoteTrackEvent : public Event {
-public:
-    /**
-     * Constructor for E-type events in the note track
-     */
-    NoteTrackEvent(uint32_t time, std::string text);
+    /** The type name, e.g. "TS" */
+    StrView typeName(const StringPool& strings) const;
     /**
-     * Constructor for N-type events in the note track
+     * Write the event as it would appear in a chart file, without the
+     * leading tab or line ending.
      */
-    NoteTrackEvent(uint32_t time, uint32_t value, uint32_t duration);
-    /**
-     * Constructor for arbitrary-type events in the note track
-     */
-    NoteTrackEvent(uint32_t time, std::string type, uint32_t value, uint32_t duration);
-    ~NoteTrackEvent();
-    std::string toEventString() const override;
-    bool isNote() const;
-    bool isFlag() const;
-    bool isEvent() const;
-    bool isStarPower() const;
+    void write(Writer& out, const StringPool& strings) const;
+    std::string toEventString(const StringPool& strings) const;
 
+    uint32_t time;
+    /** Note value, tempo, time signature numerator or star power type */
+    uint32_t value;
+    uint32_t duration;
     /**
-     * Override the < operator to enable std::sort() to work
+     * Id of the text of "E" events, or of the type name of EVENT_TYPE_OTHER.
+     * Less than EVENT_TEXT_IDS, see `Chart::internEventText`.
      */
-    friend bool operator<(const NoteTrackEvent& nte0, const NoteTrackEvent& nte1);
+    uint32_t text : 24;
+    /** An `EventType` */
+    uint32_t type : 8;
+};
 
-    /**
-     * Note value as decimal
-     */
-    uint32_t value;
-    uint32_t duration;
+static_assert(std::is_trivially_copyable<Event>::value, "Event must be trivially copyable");
+static_assert(sizeof(Event) == 16, "Event should pack into 16 bytes");
+
+/** An event in [SyncTrack] */
+typedef Event SyncTrackEvent;
+/** An event in a note track */
+typedef Event NoteTrackEvent;
+
+/**
+ * Orders events by time, then type, then text, then value, as they are
+ * written out. Text is only compared when two events tie on everything
+ * before it.
+ */
+struct EventLess {
+    explicit EventLess(const StringPool& strings) : strings(strings) {}
+    bool operator()(const Event& e0, const Event& e1) const;
+    const StringPool& strings;
 };
 
 class Note {
@@ -123,9 +147,11 @@ public:
      */
     bool equalsPlayable(const Note& note) const;
     /**
-     * Convert this `Note` into a set of `NoteTrackEvent`s and add it to the given vector.
+     * Write the "N" line of each lane and flag set in this note, as they
+     * would appear in a note section, each with its leading tab and line
+     * ending.
      */
-    void toNoteTrackEvents(std::vector<NoteTrackEvent>& vector) const;
+    void write(Writer& out) const;
 
     friend bool operator<(const Note& n0, const Note& n1);
     friend std::ostream& operator<<(std::ostream& os, const Note& n);
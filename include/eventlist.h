@@ -0,0 +1,128 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "event.h"
+#include "stringpool.h"
+
+/**
+ * Events kept in the order they are written out (see `EventLess`).
+ *
+ * Appending events in order, as they appear in a well-formed chart, keeps
+ * the list sorted. Anything that may break the order is recorded as a dirty
+ * range instead of being fixed straight away; `sort` then sorts just that
+ * range and merges it back in, so a list that was never disturbed is written
+ * without sorting at all.
+ */
+class EventList {
+public:
+    typedef std::vector<Event>::const_iterator const_iterator;
+
+    EventList() : dirtyBegin(0), dirtyEnd(0) {}
+
+    const_iterator begin() const { return events.begin(); }
+    const_iterator end() const { return events.end(); }
+    size_t size() const { return events.size(); }
+    bool empty() const { return events.empty(); }
+    const Event& operator[](size_t i) const { return events[i]; }
+    /** Mutable access to one event, which is marked dirty */
+    Event& at(size_t i);
+    void clear();
+    void reserve(size_t count) { events.reserve(count); }
+    /** Replace the contents with `other`, which need not be sorted */
+    void assign(std::vector<Event>& other);
+    /** The raw events, e.g. for serialisation. Only sorted if `sorted()`. */
+    const std::vector<Event>& data() const { return events; }
+
+    /** True if no part of the list is waiting to be sorted */
+    bool sorted() const { return dirtyBegin == dirtyEnd; }
+    /** Index of the first event at or after `tick`. The list must be sorted. */
+    size_t lowerBound(uint32_t tick) const;
+
+    /** Append an event, marking it dirty unless it belongs at the end */
+    void push_back(const Event& evt);
+    /**
+     * Insert an event at its place in the order. On a list that is not
+     * sorted, the event is appended and marked dirty instead.
+     */
+    void insert(const Event& evt, const StringPool& strings);
+    /**
+     * Move the events from index `first` onwards `delta` units later. Moving
+     * a tail of a sorted list forwards keeps it sorted.
+     */
+    void shift(uint32_t delta, size_t first = 0);
+    /**
+     * Replace every event with `fn(event)`. `fn` must keep the events in
+     * order, e.g. by moving their times in a way that keeps them in order.
+     */
+    template <typename Fn>
+    void retime(Fn fn);
+    /**
+     * Erase every event for which `pred` returns true, in one pass. The
+     * remaining events keep their order.
+     */
+    template <typename Pred>
+    size_t eraseIf(Pred pred);
+    /** Sort the dirty range into place */
+    void sort(const StringPool& strings);
+
+    void swap(EventList& other);
+private:
+    void markDirty(size_t first, size_t last);
+
+    std::vector<Event> events;
+    /** Events [dirtyBegin, dirtyEnd) may be out of order */
+    size_t dirtyBegin;
+    size_t dirtyEnd;
+};
+
+template <typename Fn>
+void EventList::retime(Fn fn) {
+    for (Event& evt : events)
+        evt = fn(evt);
+}
+
+template <typename Pred>
+size_t EventList::eraseIf(Pred pred) {
+    size_t out = 0;
+    size_t newDirtyBegin = 0;
+    size_t newDirtyEnd = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+        // Remember where the dirty range ends up once earlier events are gone
+        if (i == dirtyBegin)
+            newDirtyBegin = out;
+        if (i == dirtyEnd)
+            newDirtyEnd = out;
+        if (pred(events[i]))
+            continue;
+        events[out++] = events[i];
+    }
+    if (dirtyBegin == events.size())
+        newDirtyBegin = out;
+    if (dirtyEnd == events.size())
+        newDirtyEnd = out;
+    size_t erased = events.size() - out;
+    events.resize(out);
+    dirtyBegin = newDirtyBegin;
+    dirtyEnd = newDirtyEnd;
+    return erased;
+}
@@ -18,42 +18,154 @@
  */
 #pragma once
 
+#include <array>
 #include <map>
+#include <memory>
 #include <vector>
 
 #include "event.h"
 #include "chart.h"
+#include "diag.h"
+#include "pass.h"
+#include "patch.h"
 
 namespace fix {
 
+    /**
+     * The set of fixes to apply to a chart, as selected on the command line.
+     */
+    struct Options {
+        Options() : startEvent(false), endEvent(false), leadingMeasure(false), starPower(false),
+                sustainGap(false), feedbackSafe(false), noteFlags(true) {}
+        bool startEvent;
+        bool endEvent;
+        bool leadingMeasure;
+        bool starPower;
+        bool sustainGap;
+        /** Convert note flags to track events instead of track events to note flags */
+        bool feedbackSafe;
+        /** Set or unset note flags, according to `feedbackSafe`, along with the fixes */
+        bool noteFlags;
+    };
+
+    /**
+     * A pass that the fixes are made of. Passes run in registry order, fused
+     * into as few sweeps over each track as their access allows.
+     */
+    struct PassInfo {
+        /** Command line flag that selects the pass, e.g. "fix-sustain", or null if none does */
+        const char* flag;
+        char shortName;
+        const char* description;
+        /** The field of `Options` that selects the pass, or null if it always runs */
+        bool Options::*option;
+        /** Selected when no fix is chosen on the command line */
+        bool byDefault;
+        /** Make the pass, or return null if `options` leave it nothing to do */
+        std::unique_ptr<Pass> (*create)(const Options& options);
+    };
+    const std::vector<PassInfo>& registry();
+
+    /**
+     * Apply the fixes selected by default, then set note flags.
+     */
     void fixAll(Chart& chart);
+    /**
+     * Apply the fixes selected in `options`, then set or unset note flags.
+     */
+    void apply(Chart& chart, const Options& options);
+    /**
+     * Apply the fixes selected in `options` but leave note flags as they are,
+     * so that copies of the chart can then take either form.
+     */
+    void applyBase(Chart& chart, const Options& options);
 
     /* Chart file fixes */
     void fixMissingStartEvent(Chart& chart);
-    void fixMissingEndEvent(Chart& chart);
+    bool hasEndEvent(const Chart& chart);
+    /**
+     * Insert an end event a little after `last_note_end`, the time at which
+     * the last note of the chart finishes.
+     */
+    void addEndEvent(Chart& chart, uint32_t last_note_end);
     void fixUnprintableCharacters(Chart& chart);
 
     /* Note track fixes */
 
     /**
-     * Replace event markers with tap notes / force notes.
+     * `Chart::noteFlagMarkers` resolved against the chart's strings, so that
+     * markers are matched by text id and flag bit rather than by comparing
+     * text, however many of them there are.
+     */
+    class MarkerTable {
+    public:
+        struct Entry {
+            /** Id of the marker text in `Chart::strings` */
+            uint32_t text;
+            unsigned int flag;
+            bool replacesLanes;
+        };
+
+        MarkerTable();
+        /** Resolve the markers of `chart`. Markers whose text is not in the chart are left out. */
+        explicit MarkerTable(const Chart& chart);
+        /** The marker with the text `text`, or null if it is not a marker */
+        const Entry* find(uint32_t text) const;
+        /** The marker for flag bit `flag`, or null if it has none */
+        const Entry* forFlag(unsigned int flag) const;
+        /** The flag bits that have a marker */
+        uint32_t flags() const { return flagMask; }
+    private:
+        /** Sorted by text id */
+        std::vector<Entry> entries;
+        /** Index into `entries` by flag bit, `entries.size()` if none */
+        std::array<size_t, 32> byFlag;
+        uint32_t flagMask;
+    };
+
+    /**
+     * Replace event markers with note flags, e.g. tap notes and force notes.
      */
     void setNoteFlags(Chart& chart);
     /**
-     * Replace tap notes / force notes with event markers.
+     * As above for one track, in a single pass that steps through the events
+     * and the notes together.
+     */
+    void setNoteFlags(TrackSweep& sweep, const MarkerTable& markers);
+    /**
+     * Replace note flags with event markers.
      */
     void unsetNoteFlags(Chart& chart);
+    /**
+     * Replace the flags of note `n` with event markers. `markers` must have
+     * been resolved after `internNoteFlagEvents`.
+     */
+    void unsetNoteFlags(TrackSweep& sweep, size_t n, const MarkerTable& markers);
+    /**
+     * Add the texts of `chart.noteFlagMarkers` to `chart.strings`, so that
+     * every marker resolves and tracks can then be swept concurrently without
+     * changing the strings.
+     */
+    void internNoteFlagEvents(Chart& chart);
     /**
      * Fix the case where the note track(s) have no "leading measure", that is at least one blank measure
      * before the first note. Without this, it is possible for HOPO calculations to be incorrect at the
      * start of a song.
+     *
+     * [Song], [SyncTrack] and [Events] are changed directly, and the note
+     * tracks are shifted by one measure through `chart.timeline`. Returns true
+     * if the measure was inserted.
+     */
+    bool fixNoLeadingMeasure(Chart& chart);
+    /**
+     * Shorten the sustain of note `n - 1` if it ends less than `min_gap`
+     * before note `n`.
      */
-    void fixNoLeadingMeasure(Chart& chart);
-    void fixSustainGap(std::map<uint32_t, Note>& noteTrack, const unsigned int min_gap);
+    void fixSustainGap(TrackSweep& sweep, size_t n, unsigned int min_gap);
     void fixUnequalNoteDurations(std::vector<Note>& fixed, std::vector<NoteTrackEvent> simultaneousNoteEvents);
     /**
-     * Automatically inserts star power phrases into the chart.
+     * Automatically inserts star power phrases into a track that has none.
      */
-    void fixMissingStarPower(Chart& chart);
+    void fixMissingStarPower(TrackSweep& sweep);
 
 }
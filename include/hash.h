@@ -18,11 +18,18 @@
  */
 #pragma once
 
-#include <iostream>
-#include <fstream>
+#include <cstddef>
+#include <stdint.h>
 
-#ifndef DEBUG_PRINT
-#define DEBUG(X) do { std::cerr << "DEBUG::" << X << "\r\n"; } while (0)
-#else
-#define DEBUG(X) do { } while (0)
-#endif
\ No newline at end of file
+/**
+ * 64-bit FNV-1a hash of `size` bytes, used to check that stored data belongs
+ * to the file it was made from.
+ */
+inline uint64_t fnv1a(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,99 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include "eventlist.h"
+#include "notecolumn.h"
+#include "timeline.h"
+
+/**
+ * A static set of closed tick intervals [start, end], each carrying the
+ * index of the note or event it came from. Answers "which intervals contain
+ * tick T" and "which intervals overlap [a, b]" in O(log n + k).
+ *
+ * Intervals are kept sorted by start and viewed as an implicit balanced
+ * binary tree (the middle of each range is the root of that range), with
+ * the largest end in each subtree stored alongside. The index is not
+ * updated when the track changes; rebuild it after editing.
+ *
+ * The ticks of a note track may lag behind `Chart::timeline` (see
+ * `NoteTrack::retimed`), so they are mapped through the steps of `timeline`
+ * from `from` onwards as the index is built, and the index is in chart ticks.
+ */
+class IntervalIndex {
+public:
+    size_t size() const { return starts.size(); }
+    bool empty() const { return starts.empty(); }
+    void clear();
+
+    /** The held notes of `notes`, i.e. those with a duration, by note index */
+    void buildSustains(const NoteColumn& notes, const Timeline& timeline, size_t from);
+    /** The star power phrases ("S 2") of `events`, by event index */
+    void buildPhrases(const EventList& events, const Timeline& timeline, size_t from);
+
+    uint32_t start(size_t i) const { return starts[i]; }
+    uint64_t end(size_t i) const { return ends[i]; }
+    /** Index of the note or event the `i`th interval came from */
+    uint32_t source(size_t i) const { return sources[i]; }
+
+    /**
+     * Call `visit(i)` for every interval overlapping [begin, end], in order
+     * of start.
+     */
+    template <typename Visitor>
+    void forEachOverlap(uint64_t begin, uint64_t end, Visitor visit) const {
+        if (begin <= end)
+            visitOverlaps(0, starts.size(), begin, end, visit);
+    }
+    /** Append the source of every interval containing `tick` to `out` */
+    void stab(uint32_t tick, std::vector<uint32_t>& out) const;
+    /** Append the source of every interval overlapping [begin, end] to `out` */
+    void overlapping(uint32_t begin, uint32_t end, std::vector<uint32_t>& out) const;
+private:
+    /** Append an interval; starts must not decrease */
+    void push_back(uint32_t start, uint64_t end, uint32_t source);
+    /** Fill `maxEnds`, once every interval has been added */
+    void finish();
+    uint64_t fillMaxEnds(size_t first, size_t last);
+
+    template <typename Visitor>
+    void visitOverlaps(size_t first, size_t last, uint64_t begin, uint64_t end, Visitor& visit) const {
+        while (first < last) {
+            size_t mid = first + (last - first) / 2;
+            if (maxEnds[mid] < begin)
+                return; // Nothing in this subtree reaches `begin`
+            visitOverlaps(first, mid, begin, end, visit);
+            if (starts[mid] > end)
+                return; // Everything further right starts too late
+            if (ends[mid] >= begin)
+                visit(mid);
+            first = mid + 1;
+        }
+    }
+
+    std::vector<uint32_t> starts;
+    std::vector<uint64_t> ends;
+    std::vector<uint32_t> sources;
+    /** Largest end within the subtree rooted at each interval */
+    std::vector<uint64_t> maxEnds;
+};
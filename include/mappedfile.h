@@ -0,0 +1,51 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <istream>
+#include <string>
+
+/**
+ * Read-only contents of a chart file. Regular files are memory-mapped where
+ * the platform allows it; streams (e.g. stdin) are read into an owned buffer.
+ */
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Map the file at `fpath`. Returns false if it could not be opened.
+     */
+    bool open(const std::string& fpath);
+    /**
+     * Read the remainder of `in` into memory.
+     */
+    bool open(std::istream& in);
+    void close();
+
+    const char* data() const;
+    size_t size() const;
+private:
+    const char* mapped;
+    size_t length;
+    std::string buffer;
+};
@@ -0,0 +1,121 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#include "event.h"
+
+/**
+ * The notes of a note track, kept sorted by time with at most one note per
+ * time. Times, lane bitmasks and durations are stored in separate arrays, so
+ * a scan over one of them (e.g. looking up a time) touches only that array.
+ *
+ * Notes are addressed by index. Indices are invalidated by anything that
+ * inserts or erases notes.
+ */
+class NoteColumn {
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    size_t size() const { return times.size(); }
+    bool empty() const { return times.empty(); }
+    void clear();
+    void reserve(size_t count);
+
+    uint32_t time(size_t i) const { return times[i]; }
+    uint32_t value(size_t i) const { return values[i]; }
+    uint32_t& value(size_t i) { return values[i]; }
+    uint32_t duration(size_t i) const { return durations[i]; }
+    uint32_t& duration(size_t i) { return durations[i]; }
+    /** The times of every note, in order */
+    const uint32_t* timeData() const { return times.data(); }
+    /** A copy of the note at index `i` */
+    Note note(size_t i) const;
+
+    /** Index of the first note at or after `tick` */
+    size_t lowerBound(uint32_t tick) const;
+    /** Index of the note at exactly `tick`, or `npos` */
+    size_t find(uint32_t tick) const;
+    /** Indices [first, second) of the notes with `begin` <= time < `end` */
+    std::pair<size_t, size_t> range(uint32_t begin, uint32_t end) const;
+
+    /**
+     * Append a note. `time` must be later than every note in the column.
+     */
+    void push_back(uint32_t time, uint32_t value, uint32_t duration);
+    /**
+     * Insert a batch of notes in one pass. A note at the same time as an
+     * existing one adds its lanes to it, keeping the existing duration, as
+     * if its "N" lines had come later in the file.
+     */
+    void insert(std::vector<Note> batch);
+    /** As `insert`, for notes that are already in a column */
+    void merge(const NoteColumn& other);
+    /** Erase the notes with indices [first, last) */
+    void erase(size_t first, size_t last);
+    /**
+     * Erase every note for whose index `pred` returns true, in one pass.
+     * Returns the number of notes erased.
+     */
+    template <typename Pred>
+    size_t eraseIf(Pred pred);
+    /** Move every note `delta` units later */
+    void shift(uint32_t delta);
+    /**
+     * Call `fn(time, duration)` with references to the time and duration of
+     * every note. `fn` must keep the notes in order and apart.
+     */
+    template <typename Fn>
+    void retime(Fn fn);
+
+    void swap(NoteColumn& other);
+private:
+    std::vector<uint32_t> times;
+    /** Lane and flag bits, see NOTE_FLAG_VAL_* */
+    std::vector<uint32_t> values;
+    std::vector<uint32_t> durations;
+};
+
+template <typename Fn>
+void NoteColumn::retime(Fn fn) {
+    for (size_t i = 0; i < times.size(); i++)
+        fn(times[i], durations[i]);
+}
+
+template <typename Pred>
+size_t NoteColumn::eraseIf(Pred pred) {
+    size_t out = 0;
+    for (size_t i = 0; i < times.size(); i++) {
+        if (pred(i))
+            continue;
+        times[out] = times[i];
+        values[out] = values[i];
+        durations[out] = durations[i];
+        out++;
+    }
+    size_t erased = times.size() - out;
+    times.resize(out);
+    values.resize(out);
+    durations.resize(out);
+    return erased;
+}
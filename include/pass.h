@@ -0,0 +1,169 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chart.h"
+#include "track.h"
+
+namespace fix {
+    struct Options;
+
+    /**
+     * Parts of a note track that a pass reads or writes, as bits. [Song],
+     * [SyncTrack] and [Events] are not listed: passes only touch them in
+     * `Pass::begin` and `Pass::end`, which run in pass order.
+     */
+    enum Access {
+        ACCESS_NOTE_TIMES = 1 << 0,
+        ACCESS_NOTE_DURATIONS = 1 << 1,
+        /** Which lanes a note is played on */
+        ACCESS_NOTE_LANES = 1 << 2,
+        /** Tap, HOPO flip and other flag bits of a note */
+        ACCESS_NOTE_FLAGS = 1 << 3,
+        /** Star power and text events */
+        ACCESS_TRACK_EVENTS = 1 << 4
+    };
+
+    /**
+     * Where a pass does its work on a note track. A sweep runs every
+     * `beginTrack` of its passes, then visits each note with every pass in
+     * turn, then runs every `endTrack`.
+     */
+    enum Phase {
+        PHASE_TRACK_BEGIN,
+        PHASE_NOTES,
+        PHASE_TRACK_END
+    };
+
+    /**
+     * One note track while passes sweep over it. The track is read through
+     * `track` and only unshared from other copies of the chart (see
+     * `NoteTracks`) once a pass asks to `modify` it.
+     *
+     * The ticks in `track` may still be waiting for steps of `Chart::timeline`;
+     * `note` maps them to chart ticks. `modify` applies the steps first, so a
+     * track being modified is always in chart ticks.
+     *
+     * Tracks may be swept concurrently, so diagnostics and edits go to `log`
+     * and `edits` rather than to the chart's own.
+     */
+    class TrackSweep {
+    public:
+        /** Sweep with the chart's own log and edits */
+        TrackSweep(Chart& chart, TrackId id);
+        TrackSweep(Chart& chart, TrackId id, diag::Log& log, patch::EditList& edits);
+        const NoteTrack& track() const { return *current; }
+        /** Note `n` of the track, in chart ticks */
+        Note note(size_t n) const { return chart.timeline.map(current->notes.note(n), current->retimed); }
+        /** The track for modification. References from `track` are stale afterwards. */
+        NoteTrack& modify();
+
+        Chart& chart;
+        const TrackId id;
+        /** Section name of the track, for `edits` */
+        const std::string section;
+        diag::Log& log;
+        patch::EditList& edits;
+    private:
+        const NoteTrack* current;
+        NoteTrack* modifiable;
+    };
+
+    /**
+     * Call `fn` with a sweep of every note track in the chart, on up to
+     * `chart.threads` threads. Each sweep then has a log and edits of its own,
+     * which are added to the chart's in track order once every track is done,
+     * so the outcome does not depend on thread scheduling.
+     */
+    void sweepTracks(Chart& chart, const std::function<void(TrackSweep&)>& fn);
+
+    /**
+     * A fix, split into chart-wide work and the work it does on each note
+     * track. Passes that declare compatible access are fused by `Schedule`
+     * into a single walk over each track.
+     *
+     * The track hooks of one pass may run concurrently for different tracks.
+     * They may change only the swept track, `sweep.log` and `sweep.edits`,
+     * and any state they keep in the pass must be per track.
+     */
+    class Pass {
+    public:
+        Pass(const char* name, Phase phase, unsigned int reads, unsigned int writes);
+        virtual ~Pass() {}
+        /**
+         * Chart-wide work, done before any note track is swept. Only touches
+         * [Song], [SyncTrack], [Events] and `Chart::timeline`. Returns false if
+         * the pass has nothing to do on the note tracks.
+         */
+        virtual bool begin(Chart& /*chart*/) { return true; }
+        virtual void beginTrack(TrackSweep& /*sweep*/) {}
+        /**
+         * Visit note `n`. Only notes `n - 1` and `n` may be read or written,
+         * and no note may be added or removed.
+         */
+        virtual void visit(TrackSweep& /*sweep*/, size_t /*n*/) {}
+        virtual void endTrack(TrackSweep& /*sweep*/) {}
+        /** Chart-wide work, done after every note track has been swept */
+        virtual void end(Chart& /*chart*/) {}
+
+        /**
+         * True if this pass can share a sweep with `earlier`, a pass that
+         * runs before it, with the same result as running after it.
+         */
+        bool fusesWith(const Pass& earlier) const;
+
+        /** Short name, as used for diagnostics */
+        const char* name;
+        Phase phase;
+        /** `Access` bits of the note track */
+        unsigned int reads;
+        unsigned int writes;
+    };
+
+    /**
+     * The passes selected by `Options`, in registry order, grouped into as few
+     * sweeps over each note track as their access allows.
+     */
+    class Schedule {
+    public:
+        explicit Schedule(const Options& options);
+        /**
+         * Do the chart-wide work of every pass, then group the passes that
+         * have work on the note tracks into sweeps.
+         */
+        void begin(Chart& chart);
+        /** Run every sweep over one note track */
+        void sweep(Chart& chart, TrackId id);
+        void end(Chart& chart);
+        /** `begin`, sweep every note track in the chart (see `sweepTracks`), then `end` */
+        void run(Chart& chart);
+        /** Number of walks over each note track, known after `begin` */
+        size_t sweeps() const { return groups.size(); }
+    private:
+        void sweep(TrackSweep& sweep);
+
+        std::vector<std::unique_ptr<Pass>> passes;
+        std::vector<std::vector<Pass*>> groups;
+    };
+}
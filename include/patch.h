@@ -0,0 +1,127 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "diag.h"
+#include "event.h"
+#include "stringpool.h"
+#include "strview.h"
+#include "writer.h"
+
+/**
+ * Structured edits made by the fixes, so that a fixed chart can be shipped as
+ * the few lines that changed rather than the whole file.
+ *
+ * A patch is a text file:
+ *
+ *     chart-tidy patch 1
+ *     source <size of the original file> <FNV-1a hash of it, in hex>
+ *     [Events]
+ *     + 0 = E "section Start"
+ *     [ExpertSingle]
+ *     ~ 768 = E "solo"	768 = E solo
+ *     % 768 24
+ *     > 0 768
+ *
+ * Each `[Section]` line selects the section that the edits after it apply
+ * to. Edits are applied in order, one line per edit, see `Op`. Lines are
+ * compared token by token, so spacing in the original does not matter.
+ *
+ * A patch records only what the fixes changed. Applying it does not sort or
+ * reformat the rest of the chart the way a full write does.
+ */
+namespace patch {
+    /** The kind of an edit, written as its first character */
+    enum Op {
+        /** `+ line`: insert the line before the first line with a later tick */
+        OP_INSERT = '+',
+        /** `- line`: delete the first line equal to this one */
+        OP_DELETE = '-',
+        /** `~ line<TAB>replacement`: replace the first line equal to `line` */
+        OP_MODIFY = '~',
+        /**
+         * `% tick duration`: set the duration of every lane of the note at
+         * `tick`. The lines of a chord may disagree about the duration, since
+         * only the first one is read, so they are not matched one by one.
+         */
+        OP_DURATION = '%',
+        /** `> tick delta`: add `delta` to the tick of every line at or after `tick` */
+        OP_SHIFT = '>',
+        /** `= key = value`: set a [Song] key, replacing its line or adding one */
+        OP_SET = '='
+    };
+
+    struct Edit {
+        Op op;
+        /** Section name without brackets, e.g. "ExpertSingle" */
+        std::string section;
+        /** The tick the edit applies at, or from for a shift */
+        uint32_t tick;
+        /** The line to insert, delete or replace, or the key to set */
+        std::string line;
+        /** The replacement line, or the value to set */
+        std::string replacement;
+        /** Ticks to add for a shift, or the new duration */
+        uint32_t delta;
+    };
+
+    /**
+     * The edits made to one chart, in the order they were made. Nothing is
+     * recorded unless `enabled` is set, so the fixes can always report their
+     * edits at no cost.
+     */
+    class EditList {
+    public:
+        EditList();
+        void clear();
+
+        void insert(const std::string& section, const Event& evt, const StringPool& strings);
+        void erase(const std::string& section, const Event& evt, const StringPool& strings);
+        void modify(const std::string& section, const Event& before, const Event& after,
+                const StringPool& strings);
+        /** Change the duration of the note at `tick` */
+        void modifyDuration(const std::string& section, uint32_t tick, uint32_t duration);
+        void shift(const std::string& section, uint32_t from, uint32_t delta);
+        void set(const std::string& section, const std::string& key, const std::string& value);
+        /** Move every edit of `other` onto the end of this list */
+        void append(EditList& other);
+
+        /** Write the edits as a patch against the original file */
+        void write(Writer& out) const;
+
+        bool enabled;
+        /** Size and FNV-1a hash of the file the edits were made to */
+        uint64_t sourceSize;
+        uint64_t sourceHash;
+        std::vector<Edit> edits;
+    };
+
+    /**
+     * Apply the patch `patchText` to the chart text `original` and write the
+     * result to `out`, without parsing the chart. Sections without edits are
+     * copied byte for byte. A section that the chart does not have is added
+     * with the lines the edits give it, in its place among the others. Fails, with diagnostics in `log`, if the patch
+     * was made from a different file or an edit does not match the chart.
+     */
+    bool apply(StrView original, StrView patchText, Writer& out, diag::Log& log);
+}
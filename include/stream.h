@@ -0,0 +1,44 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <iostream>
+
+#include "chart.h"
+#include "diag.h"
+#include "fix.h"
+
+namespace stream {
+    /**
+     * Read a chart from `in`, fix it and write it to `out` a section at a time,
+     * so that only the metadata sections and one note track are held in
+     * memory at once. [Song], [SyncTrack] and [Events] are written as soon as
+     * the first note track is reached, and each note track is fixed and
+     * written as soon as its closing brace is read.
+     *
+     * If an end event has to be inserted, its time is only known once every
+     * note track has been read, so [Events] is then written last.
+     *
+     * `chart` supplies the settings (tap/HOPO events, sustain gap, tracks) and
+     * is left holding the metadata sections. Diagnostics are written to `err`
+     * after each section.
+     */
+    bool tidy(std::istream& in, std::ostream& out, Chart& chart, const fix::Options& options,
+            std::ostream& err, diag::Format format);
+}
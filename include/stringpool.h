@@ -0,0 +1,63 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "arena.h"
+#include "strview.h"
+
+/**
+ * Interned event text. Each distinct string is stored once and referred to
+ * by a small integer id, so events can hold text without owning it and
+ * equal texts compare by id. Id 0 is always the empty string.
+ *
+ * The characters live in an `Arena` and ids are found through an open
+ * addressing table, so interning allocates nothing per string, and `clear`
+ * keeps all of the memory for the next chart.
+ */
+class StringPool {
+public:
+    StringPool();
+    StringPool(const StringPool& other);
+    StringPool& operator=(const StringPool& other);
+
+    /** The id of `str`, adding it to the pool if necessary */
+    uint32_t intern(StrView str);
+    /** Look up `str` without adding it. Returns false if it is not in the pool. */
+    bool find(StrView str, uint32_t& id) const;
+    /** The text of `id`, valid until the pool is cleared or destroyed */
+    StrView get(uint32_t id) const { return views[id]; }
+    size_t size() const { return views.size(); }
+    /** Remove every string except the empty string, keeping the memory */
+    void clear();
+    void swap(StringPool& other);
+private:
+    static size_t hash(StrView str);
+    /** The slot of `table` that holds `str`, or the empty slot where it belongs */
+    size_t slot(StrView str) const;
+    void grow();
+
+    Arena arena;
+    /** Text of each string, by id */
+    std::vector<StrView> views;
+    /** Power-of-two sized hash table of id + 1, 0 for an empty slot */
+    std::vector<uint32_t> table;
+};
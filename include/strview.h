@@ -0,0 +1,163 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstring>
+#include <cstdlib>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+
+/**
+ * A non-owning view of a range of characters, used to tokenize chart files
+ * without copying every field into its own `std::string`. The referenced
+ * buffer must outlive the view.
+ */
+struct StrView {
+    StrView() : first(nullptr), last(nullptr) {}
+    StrView(const char* first, const char* last) : first(first), last(last) {}
+    StrView(const char* str) : first(str), last(str + strlen(str)) {}
+    StrView(const std::string& str) : first(str.data()), last(str.data() + str.size()) {}
+
+    const char* begin() const { return first; }
+    const char* end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+    char front() const { return *first; }
+    char back() const { return *(last - 1); }
+    std::string str() const { return std::string(first, last); }
+
+    StrView substr(size_t pos, size_t len) const {
+        return StrView(first + pos, first + pos + len);
+    }
+
+    bool startsWith(StrView prefix) const {
+        return size() >= prefix.size() && (prefix.empty() || memcmp(first, prefix.first, prefix.size()) == 0);
+    }
+
+    bool endsWith(StrView suffix) const {
+        return size() >= suffix.size() && (suffix.empty()
+                || memcmp(last - suffix.size(), suffix.first, suffix.size()) == 0);
+    }
+
+    /**
+     * Remove leading and trailing whitespace, as `boost::trim` would.
+     */
+    StrView trim() const {
+        const char* b = first;
+        const char* e = last;
+        while (b != e && isSpace(*b))
+            ++b;
+        while (e != b && isSpace(*(e - 1)))
+            --e;
+        return StrView(b, e);
+    }
+
+    /**
+     * Split this view at the first occurrence of `delim` into `head` and
+     * `tail`, trimming both. If `delim` is not found, `head` is the whole
+     * (trimmed) view and `tail` is empty.
+     */
+    void splitOnce(StrView& head, StrView& tail, char delim) const {
+        const char* idx = empty() ? nullptr : static_cast<const char*>(memchr(first, delim, size()));
+        if (idx != nullptr) {
+            head = StrView(first, idx).trim();
+            tail = StrView(idx + 1, last).trim();
+        } else {
+            head = trim();
+            tail = StrView(last, last);
+        }
+    }
+
+    /**
+     * Parse the whole view as an unsigned decimal integer. Returns false if
+     * the view is empty, contains anything other than digits, or overflows.
+     */
+    bool toUint(uint32_t& out) const {
+        if (empty())
+            return false;
+        uint64_t val = 0;
+        for (const char* c = first; c != last; ++c) {
+            if (*c < '0' || *c > '9')
+                return false;
+            val = val * 10 + (*c - '0');
+            if (val > 0xFFFFFFFFUL)
+                return false;
+        }
+        out = static_cast<uint32_t>(val);
+        return true;
+    }
+
+    bool toInt(int& out) const {
+        if (!empty() && front() == '-') {
+            uint32_t val;
+            if (!StrView(first + 1, last).toUint(val) || val > 0x80000000UL)
+                return false;
+            out = -static_cast<int64_t>(val);
+            return true;
+        }
+        uint32_t val;
+        if (!toUint(val) || val > 0x7FFFFFFFUL)
+            return false;
+        out = static_cast<int>(val);
+        return true;
+    }
+
+    /**
+     * Parse the whole view as a floating point number. Numbers in charts are
+     * short, so they are copied to a stack buffer for `strtod` rather than
+     * allocating.
+     */
+    bool toDouble(double& out) const {
+        char buf[64];
+        if (empty() || size() >= sizeof(buf))
+            return false;
+        memcpy(buf, first, size());
+        buf[size()] = '\0';
+        char* endp;
+        out = strtod(buf, &endp);
+        return endp == buf + size();
+    }
+
+    friend bool operator==(StrView a, StrView b) {
+        return a.size() == b.size() && (a.empty() || memcmp(a.first, b.first, a.size()) == 0);
+    }
+
+    friend bool operator!=(StrView a, StrView b) {
+        return !(a == b);
+    }
+
+    /** Lexicographic order, as for `std::string` */
+    friend bool operator<(StrView a, StrView b) {
+        size_t len = a.size() < b.size() ? a.size() : b.size();
+        int cmp = len == 0 ? 0 : memcmp(a.first, b.first, len);
+        return cmp < 0 || (cmp == 0 && a.size() < b.size());
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, StrView v) {
+        return os.write(v.first, v.size());
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+    }
+
+    const char* first;
+    const char* last;
+};
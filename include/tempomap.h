@@ -0,0 +1,86 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include "eventlist.h"
+#include "notecolumn.h"
+#include "timeline.h"
+#include "timing.h"
+
+/** Tempo assumed before the first "B" event, in BPM * 1000 */
+const uint32_t DEFAULT_BPMT = 120000;
+
+/**
+ * Converts between ticks and real time, in microseconds from the start of
+ * the chart, across every tempo change in [SyncTrack]. Built once from the
+ * sync track; lookups are binary searches over the tempo segments.
+ */
+class TempoMap {
+public:
+    TempoMap();
+    TempoMap(const EventList& syncTrack, int resolution);
+    /**
+     * Rebuild the map. `syncTrack` must be sorted. A `resolution` of 0 or
+     * less means DEFAULT_RESOLUTION.
+     */
+    void build(const EventList& syncTrack, int resolution);
+
+    uint64_t tickToMicros(uint32_t tick) const;
+    /** The last tick that starts at or before `micros` */
+    uint32_t microsToTick(uint64_t micros) const;
+    /**
+     * Convert `count` ticks at once. Ascending runs of ticks, such as the
+     * times of a note column, are converted in a single pass over the
+     * segments instead of one search per tick.
+     */
+    void ticksToMicros(const uint32_t* ticks, size_t count, uint64_t* out) const;
+    /**
+     * Convert the time of every note in `notes`. The ticks of a note track
+     * may lag behind `Chart::timeline`, so they are first mapped through the
+     * steps of `timeline` from `from` onwards, i.e. `NoteTrack::retimed`.
+     */
+    void ticksToMicros(const NoteColumn& notes, const Timeline& timeline, size_t from,
+            std::vector<uint64_t>& out) const;
+
+    /** Tempo at `tick`, in BPM * 1000 */
+    uint32_t bpmTAt(uint32_t tick) const;
+    /** Time signature numerator at `tick`, in beats per measure */
+    uint32_t beatsPerMeasureAt(uint32_t tick) const;
+    unsigned int resolution() const { return ticksPerBeat; }
+private:
+    /** A stretch of the chart with a constant tempo */
+    struct Segment {
+        uint32_t tick;
+        uint32_t bpmT;
+        /** Time at which the segment starts */
+        uint64_t micros;
+    };
+    /** Index of the segment containing `tick` */
+    size_t segmentAt(uint32_t tick) const;
+    uint64_t toMicros(const Segment& seg, uint32_t tick) const;
+
+    std::vector<Segment> segments;
+    /** Time signature changes, as (tick, numerator) */
+    std::vector<std::pair<uint32_t, uint32_t> > timeSignatures;
+    unsigned int ticksPerBeat;
+};
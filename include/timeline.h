@@ -0,0 +1,82 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include "event.h"
+
+/**
+ * A change to the ticks of a chart, recorded as a list of steps instead of
+ * being applied straight away. Each step stretches every tick and then moves
+ * the ticks at or after some point later, so ticks keep their order and no
+ * two ticks meet. Containers can therefore keep the ticks they hold and map
+ * them through the steps they have not applied yet, as they are read or
+ * written, or apply the steps once when they are next modified.
+ */
+class Timeline {
+public:
+    /** Move every tick at or after `tick` `length` later, e.g. to insert a measure */
+    void insert(uint32_t tick, uint32_t length);
+    /** Move every tick `delta` later */
+    void shift(uint32_t delta) { insert(0, delta); }
+    /**
+     * Stretch every tick by `num` / `den`, rounding down, e.g. 5 / 2 to go
+     * from 192 to 480 ticks per beat. Returns false and does nothing if
+     * `num` < `den`, since shrinking could merge separate ticks.
+     */
+    bool scale(uint32_t num, uint32_t den);
+    void clear() { steps.clear(); }
+    /** Number of steps recorded so far */
+    size_t size() const { return steps.size(); }
+    bool empty() const { return steps.empty(); }
+
+    /**
+     * `tick` moved by the steps from index `from` onwards. Mapping through no
+     * steps, e.g. for a container that is up to date, costs one comparison.
+     */
+    uint32_t map(uint32_t tick, size_t from = 0) const {
+        return from < steps.size() ? mapSteps(tick, from) : tick;
+    }
+    /** The length that `duration` ticks starting at `tick` become */
+    uint32_t mapDuration(uint32_t tick, uint32_t duration, size_t from = 0) const {
+        return from < steps.size() ? mapSteps(tick + duration, from) - mapSteps(tick, from) : duration;
+    }
+    Note map(Note note, size_t from = 0) const {
+        return from < steps.size() ? mapSteps(note, from) : note;
+    }
+    Event map(const Event& evt, size_t from = 0) const {
+        return from < steps.size() ? mapSteps(evt, from) : evt;
+    }
+private:
+    uint32_t mapSteps(uint32_t tick, size_t from) const;
+    Note mapSteps(Note note, size_t from) const;
+    Event mapSteps(Event evt, size_t from) const;
+
+    struct Step {
+        uint32_t num;
+        uint32_t den;
+        /** Ticks at or after `tick`, once stretched, move `length` later */
+        uint32_t tick;
+        uint32_t length;
+    };
+    std::vector<Step> steps;
+};
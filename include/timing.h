@@ -0,0 +1,85 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+/**
+ * Tick arithmetic that follows the chart's resolution. The constants in
+ * FeedBack.h only hold for FeedBack's default resolution of 192, while
+ * newer charts commonly use 480 or 960.
+ */
+
+/** Resolution assumed when a chart does not give one, in ticks per beat */
+const unsigned int DEFAULT_RESOLUTION = 192;
+
+namespace timing {
+    /** `resolution`, or DEFAULT_RESOLUTION if it is not positive */
+    inline unsigned int ticksPerBeat(int resolution) {
+        return resolution > 0 ? static_cast<unsigned int>(resolution) : DEFAULT_RESOLUTION;
+    }
+
+    /**
+     * Length in ticks of 1/`division` of a 4/4 measure, e.g. duration(r, 1)
+     * is a measure and duration(r, 32) a 32nd note. Never less than 1.
+     */
+    inline unsigned int duration(int resolution, unsigned int division) {
+        unsigned int ticks = ticksPerBeat(resolution) * 4 / division;
+        return ticks > 0 ? ticks : 1;
+    }
+
+    /**
+     * Divide each of `count` ticks by the length of 1/DIVISION of a measure
+     * at a resolution known at compile time, so that the division becomes a
+     * multiplication by a constant.
+     */
+    template <unsigned int TICKS_PER_BEAT, unsigned int DIVISION>
+    void toUnitsFixed(const uint32_t* ticks, size_t count, uint32_t* out) {
+        static_assert(TICKS_PER_BEAT * 4 % DIVISION == 0, "DIVISION must divide a measure evenly");
+        const uint32_t unit = TICKS_PER_BEAT * 4 / DIVISION;
+        for (size_t i = 0; i < count; i++)
+            out[i] = ticks[i] / unit;
+    }
+
+    /**
+     * Divide each of `count` ticks by the length of 1/DIVISION of a measure,
+     * e.g. toUnits<16> gives the index of the 16th note each tick falls in.
+     * The common resolutions of 192, 480 and 960 use a fixed kernel; any
+     * other resolution falls back to a runtime divisor.
+     */
+    template <unsigned int DIVISION>
+    void toUnits(int resolution, const uint32_t* ticks, size_t count, uint32_t* out) {
+        switch (ticksPerBeat(resolution)) {
+        case 192:
+            toUnitsFixed<192, DIVISION>(ticks, count, out);
+            return;
+        case 480:
+            toUnitsFixed<480, DIVISION>(ticks, count, out);
+            return;
+        case 960:
+            toUnitsFixed<960, DIVISION>(ticks, count, out);
+            return;
+        default:
+            const uint32_t unit = duration(resolution, DIVISION);
+            for (size_t i = 0; i < count; i++)
+                out[i] = ticks[i] / unit;
+        }
+    }
+}
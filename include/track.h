@@ -0,0 +1,98 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+#include "strview.h"
+
+/**
+ * Note track difficulties, in the order their tracks are written out.
+ */
+enum Difficulty {
+    DIFFICULTY_EXPERT,
+    DIFFICULTY_HARD,
+    DIFFICULTY_MEDIUM,
+    DIFFICULTY_EASY,
+    DIFFICULTY_COUNT
+};
+
+/**
+ * Note track instruments, in the order their tracks are written out.
+ */
+enum Instrument {
+    INSTRUMENT_SINGLE,
+    INSTRUMENT_DOUBLE_GUITAR,
+    INSTRUMENT_DOUBLE_BASS,
+    INSTRUMENT_ENHANCED_GUITAR,
+    INSTRUMENT_COOP_LEAD,
+    INSTRUMENT_COOP_BASS,
+    INSTRUMENT_10_KEY_GUITAR,
+    INSTRUMENT_DRUMS,
+    INSTRUMENT_DOUBLE_DRUMS,
+    INSTRUMENT_VOCALS,
+    INSTRUMENT_KEYBOARD,
+    INSTRUMENT_COUNT
+};
+
+/** Section name prefixes, indexed by `Difficulty` */
+static const char* const DIFFICULTY_NAMES[DIFFICULTY_COUNT] = {
+    "Expert", "Hard", "Medium", "Easy"
+};
+
+/** Section name suffixes, indexed by `Instrument` */
+static const char* const INSTRUMENT_NAMES[INSTRUMENT_COUNT] = {
+    "Single", "DoubleGuitar", "DoubleBass", "EnhancedGuitar", "CoopLead", "CoopBass",
+    "10KeyGuitar", "Drums", "DoubleDrums", "Vocals", "Keyboard"
+};
+
+/**
+ * Identifies a note track, e.g. [ExpertSingle], by its difficulty and
+ * instrument. Section names are resolved to a `TrackId` once when the chart
+ * is read; after that a track is just an index into a fixed-size array.
+ */
+class TrackId {
+public:
+    static const unsigned int COUNT = DIFFICULTY_COUNT * INSTRUMENT_COUNT;
+
+    /** An invalid track, i.e. not a note section */
+    TrackId() : idx(COUNT) {}
+    TrackId(Instrument instrument, Difficulty difficulty) :
+        idx(instrument * DIFFICULTY_COUNT + difficulty) {}
+    explicit TrackId(unsigned int index) : idx(index) {}
+
+    /**
+     * Resolve a section name such as "ExpertSingle". Returns an invalid
+     * `TrackId` if the name is not a note section.
+     */
+    static TrackId fromName(StrView name);
+
+    bool valid() const { return idx < COUNT; }
+    unsigned int index() const { return idx; }
+    Difficulty difficulty() const { return static_cast<Difficulty>(idx % DIFFICULTY_COUNT); }
+    Instrument instrument() const { return static_cast<Instrument>(idx / DIFFICULTY_COUNT); }
+    std::string name() const;
+
+    friend bool operator==(TrackId a, TrackId b) { return a.idx == b.idx; }
+    friend bool operator!=(TrackId a, TrackId b) { return a.idx != b.idx; }
+    friend bool operator<(TrackId a, TrackId b) { return a.idx < b.idx; }
+private:
+    uint8_t idx;
+};
@@ -0,0 +1,127 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "mappedfile.h"
+#include "strview.h"
+
+/**
+ * Buffered text output for chart files. Numbers are formatted straight into
+ * the buffer rather than through a stream, and each full block is handed to
+ * the destination as it is filled, so the whole file is never held in memory
+ * as a string. The destination is a file (written through its descriptor
+ * where the platform allows it), a stream or a string.
+ *
+ * A file is never written in place: output goes to a temporary file in the
+ * same directory, which is synced to disk and then renamed over the file on
+ * `close`, so an interrupted write or a crash leaves the old file intact.
+ * The replacement keeps the permissions of the old file, and a symbolic link
+ * is written through to the file it points to. While the output matches the
+ * existing file byte for byte nothing is written at all, and if it matches
+ * to the end the file is left alone.
+ */
+class Writer {
+public:
+    /** Largest buffer kept before it is handed to the destination */
+    static const size_t BLOCK_SIZE = 1 << 16;
+
+    /** Write to standard output */
+    Writer();
+    explicit Writer(std::ostream& out);
+    /** Append to `out`, which is reserved to fit any `reserve` hint */
+    explicit Writer(std::string& out);
+    ~Writer();
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    /**
+     * Write to the file at `fpath` instead, replacing it on `close`.
+     * Returns false if it could not be opened.
+     */
+    bool open(const std::string& fpath);
+    /**
+     * Flush, and replace the file given to `open` with the output unless it
+     * is unchanged. False if any write failed, in which case the file is
+     * left as it was.
+     */
+    bool close();
+    /** After `close`, true if the file already held exactly the output */
+    bool unchanged() const { return sameAsPrevious; }
+    /** Hint the total number of bytes that will be written */
+    void reserve(size_t bytes);
+
+    Writer& put(char c) {
+        if (used == buffer.size())
+            spill();
+        buffer[used++] = c;
+        return *this;
+    }
+    /** A string literal, whose length is known at compile time */
+    template <size_t N>
+    Writer& put(const char (&s)[N]) { return put(s, N - 1); }
+    Writer& put(StrView s) { return put(s.begin(), s.size()); }
+    Writer& put(const std::string& s) { return put(s.data(), s.size()); }
+    Writer& put(const char* s, size_t length);
+    Writer& putUnsigned(uint64_t value);
+    Writer& putSigned(int64_t value);
+    /** Format as `std::ostream` does by default, i.e. "%g" */
+    Writer& putDouble(double value);
+
+    /** Hand everything buffered to the destination. False if any write failed. */
+    bool flush();
+    /** False once any write has failed */
+    bool ok() const { return good; }
+private:
+    explicit Writer(size_t bufferSize);
+    /** Hand the buffered bytes to the destination, emptying the buffer */
+    void spill();
+    /** Compare with the file being replaced, then pass on to `emit` */
+    void sink(const char* data, size_t length);
+    void emit(const char* data, size_t length);
+    /** Start writing the temporary file, beginning with the matched bytes */
+    void diverge();
+
+    std::vector<char> buffer;
+    size_t used;
+    bool good;
+    /** The file being replaced, see `open`, with any symbolic link resolved */
+    std::string path;
+    std::string tmpPath;
+    /** Permission bits for the replacement: those of the file being replaced, if any */
+    unsigned int mode;
+    MappedFile previous;
+    bool previousExists;
+    /** Bytes of output so far, all equal to the start of `previous` */
+    size_t matched;
+    bool diverged;
+    bool sameAsPrevious;
+    /** Destination, in order of preference; unused ones are -1 or null */
+    int fd;
+    bool ownsFd;
+    std::ostream* stream;
+    std::string* str;
+    std::ofstream file;
+};
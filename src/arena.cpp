@@ -0,0 +1,80 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <utility>
+
+#include "arena.h"
+
+const size_t Arena::MIN_BLOCK_SIZE;
+
+Arena::Arena() :
+current(0), used(0) {
+}
+
+Arena::~Arena() {
+	release();
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+	while (current < blocks.size()) {
+		size_t start = (used + align - 1) & ~(align - 1);
+		if (start + size <= blocks[current].size) {
+			used = start + size;
+			return blocks[current].data + start;
+		}
+		// Move on to the next block, left over from before a reset
+		current++;
+		used = 0;
+	}
+	// Blocks double in size so that the number of blocks stays small
+	size_t blockSize = blocks.empty() ? MIN_BLOCK_SIZE : blocks.back().size * 2;
+	while (blockSize < size + align)
+		blockSize *= 2;
+	Block block;
+	block.data = static_cast<char*>(::operator new(blockSize));
+	block.size = blockSize;
+	blocks.push_back(block);
+	current = blocks.size() - 1;
+	used = 0;
+	return allocate(size, align);
+}
+
+void Arena::reset() {
+	current = 0;
+	used = 0;
+}
+
+void Arena::release() {
+	for (Block& block : blocks)
+		::operator delete(block.data);
+	blocks.clear();
+	reset();
+}
+
+void Arena::swap(Arena& other) {
+	blocks.swap(other.blocks);
+	std::swap(current, other.current);
+	std::swap(used, other.used);
+}
+
+size_t Arena::capacity() const {
+	size_t total = 0;
+	for (const Block& block : blocks)
+		total += block.size;
+	return total;
+}
@@ -0,0 +1,303 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "cache.h"
+#include "hash.h"
+#include "mappedfile.h"
+
+namespace {
+	bool sourceHash(const std::string& chartPath, uint64_t& size, uint64_t& hash) {
+		MappedFile file;
+		if (!file.open(chartPath))
+			return false;
+		size = file.size();
+		hash = fnv1a(file.data(), file.size());
+		return true;
+	}
+
+	/**
+	 * Appends values to the payload buffer.
+	 */
+	class PayloadWriter {
+	public:
+		PayloadWriter(std::string& buf) : buf(buf) {}
+		template <typename T>
+		void pod(const T& value) {
+			buf.append(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+		void str(StrView s) {
+			pod<uint32_t>(s.size());
+			buf.append(s.begin(), s.size());
+		}
+		/** Events are trivially copyable, so they are stored as they are in memory */
+		void events(const std::vector<Event>& events) {
+			pod<uint32_t>(events.size());
+			buf.append(reinterpret_cast<const char*>(events.data()), events.size() * sizeof(Event));
+		}
+	private:
+		std::string& buf;
+	};
+
+	/**
+	 * Reads values back out of a mapped payload. Reading past the end sets
+	 * `ok` to false and yields zeroes, so callers only need to check once.
+	 */
+	class PayloadReader {
+	public:
+		PayloadReader(const char* pos, const char* end) : ok(true), pos(pos), end(end) {}
+		template <typename T>
+		T pod() {
+			T value = T();
+			if (!take(sizeof(T)))
+				return value;
+			memcpy(&value, pos - sizeof(T), sizeof(T));
+			return value;
+		}
+		std::string str() {
+			uint32_t size = pod<uint32_t>();
+			if (!take(size))
+				return std::string();
+			return std::string(pos - size, size);
+		}
+		/**
+		 * Read an array written by `PayloadWriter::events`, checking that every
+		 * event refers to a known type and string.
+		 */
+		bool events(std::vector<Event>& events, const StringPool& strings) {
+			uint32_t count = pod<uint32_t>();
+			if (!fits(count, sizeof(Event)))
+				return false;
+			events.resize(count);
+			if (count > 0)
+				memcpy(&events[0], pos, count * sizeof(Event));
+			pos += count * sizeof(Event);
+			for (const Event& evt : events) {
+				if (evt.type >= EVENT_TYPE_COUNT || evt.text >= strings.size())
+					ok = false;
+			}
+			return ok;
+		}
+		/** Check that `count` items of `size` bytes remain, so that containers can be presized */
+		bool fits(uint32_t count, size_t size) {
+			if (static_cast<size_t>(end - pos) / size < count)
+				ok = false;
+			return ok;
+		}
+		bool ok;
+	private:
+		bool take(size_t size) {
+			if (!ok || static_cast<size_t>(end - pos) < size) {
+				ok = false;
+				return false;
+			}
+			pos += size;
+			return true;
+		}
+		const char* pos;
+		const char* end;
+	};
+}
+
+std::string cache::path(const std::string& chartPath) {
+	const std::string ext = ".chart";
+	if (chartPath.size() > ext.size() && chartPath.compare(chartPath.size() - ext.size(), ext.size(), ext) == 0)
+		return chartPath.substr(0, chartPath.size() - ext.size()) + ".ctb";
+	return chartPath + ".ctb";
+}
+
+bool cache::load(Chart& chart, const std::string& chartPath) {
+	MappedFile file;
+	if (!file.open(path(chartPath)) || file.size() < sizeof(Header))
+		return false;
+
+	Header header;
+	memcpy(&header, file.data(), sizeof(Header));
+	const char* payload = file.data() + sizeof(Header);
+	if (header.magic != MAGIC || header.version != VERSION || header.payloadSize != file.size() - sizeof(Header))
+		return false;
+	// Hashing the source is still far cheaper than parsing it
+	uint64_t size;
+	uint64_t hash;
+	if (!sourceHash(chartPath, size, hash) || header.sourceSize != size
+			|| header.sourceHash != hash || header.payloadHash != fnv1a(payload, header.payloadSize))
+		return false;
+
+	// Parse into a scratch chart so that a truncated payload leaves `chart` alone
+	Chart parsed;
+	PayloadReader in(payload, payload + header.payloadSize);
+	parsed.name = in.str();
+	parsed.artist = in.str();
+	parsed.charter = in.str();
+	parsed.offset = in.pod<double>();
+	parsed.resolution = in.pod<int32_t>();
+	parsed.player2 = in.str();
+	parsed.difficulty = in.pod<int32_t>();
+	parsed.previewStart = in.pod<double>();
+	parsed.previewEnd = in.pod<double>();
+	parsed.genre = in.str();
+	parsed.mediaType = in.str();
+	parsed.musicStream = in.str();
+
+	// Strings are stored in id order, starting after the empty string
+	uint32_t count = in.pod<uint32_t>();
+	if (!in.fits(count, sizeof(uint32_t)))
+		return false;
+	for (uint32_t i = 1; i <= count && in.ok; i++) {
+		if (parsed.strings.intern(in.str()) != i)
+			return false; // Duplicate string
+	}
+	std::vector<Event> events;
+	if (!in.events(events, parsed.strings))
+		return false;
+	parsed.syncTrack.assign(events);
+	if (!in.events(events, parsed.strings))
+		return false;
+	parsed.events.assign(events);
+
+	count = in.pod<uint32_t>();
+	if (!in.fits(count, 2 * sizeof(uint32_t)))
+		return false;
+	for (uint32_t i = 0; i < count && in.ok; i++) {
+		RawSection raw;
+		raw.name = in.str();
+		raw.body = in.str();
+		parsed.rawSections.push_back(raw);
+	}
+
+	uint32_t tracks = in.pod<uint32_t>();
+	for (uint32_t t = 0; t < tracks && in.ok; t++) {
+		TrackId id(in.pod<uint8_t>());
+		if (!id.valid())
+			return false;
+		NoteTrack& track = parsed.noteTracks[id.index()];
+		track.present = true;
+
+		// Notes are stored in time order, so they can be appended as they are
+		count = in.pod<uint32_t>();
+		if (!in.fits(count, 3 * sizeof(uint32_t)))
+			return false;
+		track.notes.reserve(count);
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t time = in.pod<uint32_t>();
+			uint32_t value = in.pod<uint32_t>();
+			uint32_t duration = in.pod<uint32_t>();
+			if (!track.notes.empty() && track.notes.time(track.notes.size() - 1) >= time)
+				return false;
+			track.notes.push_back(time, value, duration);
+		}
+		if (!in.events(events, parsed.strings))
+			return false;
+		track.events.assign(events);
+	}
+	if (!in.ok)
+		return false;
+
+	chart.name.swap(parsed.name);
+	chart.artist.swap(parsed.artist);
+	chart.charter.swap(parsed.charter);
+	chart.offset = parsed.offset;
+	chart.resolution = parsed.resolution;
+	chart.player2.swap(parsed.player2);
+	chart.difficulty = parsed.difficulty;
+	chart.previewStart = parsed.previewStart;
+	chart.previewEnd = parsed.previewEnd;
+	chart.genre.swap(parsed.genre);
+	chart.mediaType.swap(parsed.mediaType);
+	chart.musicStream.swap(parsed.musicStream);
+	chart.strings.swap(parsed.strings);
+	chart.syncTrack.swap(parsed.syncTrack);
+	chart.events.swap(parsed.events);
+	chart.noteTracks.swap(parsed.noteTracks);
+	chart.rawSections.swap(parsed.rawSections);
+	chart.sections.clear();
+	return true;
+}
+
+bool cache::save(const Chart& chart, const std::string& chartPath) {
+	Header header;
+	if (!sourceHash(chartPath, header.sourceSize, header.sourceHash))
+		return false;
+
+	std::string payload;
+	PayloadWriter out(payload);
+	out.str(chart.name);
+	out.str(chart.artist);
+	out.str(chart.charter);
+	out.pod<double>(chart.offset);
+	out.pod<int32_t>(chart.resolution);
+	out.str(chart.player2);
+	out.pod<int32_t>(chart.difficulty);
+	out.pod<double>(chart.previewStart);
+	out.pod<double>(chart.previewEnd);
+	out.str(chart.genre);
+	out.str(chart.mediaType);
+	out.str(chart.musicStream);
+
+	out.pod<uint32_t>(chart.strings.size() - 1);
+	for (uint32_t i = 1; i < chart.strings.size(); i++)
+		out.str(chart.strings.get(i));
+	out.events(chart.syncTrack.data());
+	out.events(chart.events.data());
+	out.pod<uint32_t>(chart.rawSections.size());
+	for (const RawSection& raw : chart.rawSections) {
+		out.str(raw.name);
+		out.str(raw.body);
+	}
+
+	uint32_t tracks = 0;
+	for (const NoteTrack& track : chart.noteTracks)
+		tracks += track.present;
+	out.pod<uint32_t>(tracks);
+	for (unsigned int i = 0; i < TrackId::COUNT; i++) {
+		const NoteTrack& track = chart.noteTracks[i];
+		if (!track.present)
+			continue;
+		out.pod<uint8_t>(i);
+		out.pod<uint32_t>(track.notes.size());
+		for (size_t n = 0; n < track.notes.size(); n++) {
+			out.pod<uint32_t>(track.notes.time(n));
+			out.pod<uint32_t>(track.notes.value(n));
+			out.pod<uint32_t>(track.notes.duration(n));
+		}
+		out.events(track.events.data());
+	}
+
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.payloadSize = payload.size();
+	header.payloadHash = fnv1a(payload.data(), payload.size());
+
+	// Write to a temporary file first so that a reader never maps a partial cache
+	std::string fpath = path(chartPath);
+	std::string tmp = fpath + ".tmp";
+	{
+		std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(payload.data(), payload.size());
+		if (!file) {
+			file.close();
+			std::remove(tmp.c_str());
+			return false;
+		}
+	}
+	return std::rename(tmp.c_str(), fpath.c_str()) == 0;
+}
@@ -16,345 +16,799 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include <boost/algorithm/string.hpp>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
 #include <set>
+#include <utility>
 #include <vector>
 
+#include "cache.h"
 #include "chart.h"
-#include "debug.h"
+#include "diag.h"
 #include "event.h"
+#include "hash.h"
+#include "mappedfile.h"
+#include "parallel.h"
+#include "timing.h"
+#include "writer.h"
+
+StrView nextLine(const char*& pos, const char* end);
+const char* findBlockEnd(const char*& pos, const char* end);
+
+Chart::Chart() :
+lazy(false), threads(1), useCache(false) {
+	clear();
+}
 
-#define SONG_SECTION "Song"
-#define SYNC_TRACK_SECTION "SyncTrack"
-#define EVENTS_SECTION "Events"
+Chart::~Chart() {
+}
 
-void splitOnce(std::string& first, std::string& second, std::string str);
-bool isNoteSection(const std::string& section);
+void Chart::clear() {
+	name.clear();
+	artist.clear();
+	charter.clear();
+	offset = 0;
+	resolution = 0;
+	player2.clear();
+	difficulty = 0;
+	previewStart = 0;
+	previewEnd = 0;
+	genre.clear();
+	mediaType.clear();
+	musicStream.clear();
+	syncTrack.clear();
+	events.clear();
+	strings.clear();
+	noteTracks.clear();
+	sections.clear();
+	rawSections.clear();
+	log.records.clear();
+	edits.clear();
+	timeline.clear();
+	source.reset();
+}
 
-Chart::Chart() {
+NoteTracks::NoteTracks() {
+	for (std::shared_ptr<NoteTrack>& track : tracks)
+		track = std::make_shared<NoteTrack>();
 }
 
-Chart::~Chart() {
+NoteTrack& NoteTracks::operator[](size_t i) {
+	if (tracks[i].use_count() > 1)
+		tracks[i] = std::make_shared<NoteTrack>(*tracks[i]);
+	return *tracks[i];
+}
+
+void NoteTracks::clear() {
+	for (std::shared_ptr<NoteTrack>& track : tracks) {
+		if (track.use_count() > 1)
+			track = std::make_shared<NoteTrack>();
+		else
+			track->clear();
+	}
+}
+
+void NoteTrack::clear() {
+	present = false;
+	notes.clear();
+	events.clear();
+	retimed = 0;
+}
+
+void NoteTrack::settle(const Timeline& timeline) {
+	if (retimed == timeline.size())
+		return;
+	size_t from = retimed;
+	notes.retime([&](uint32_t& time, uint32_t& duration) {
+		duration = timeline.mapDuration(time, duration, from);
+		time = timeline.map(time, from);
+	});
+	events.retime([&](const Event& evt) { return timeline.map(evt, from); });
+	retimed = timeline.size();
 }
 
 bool Chart::read(std::string fpath) {
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	log.file = fpath;
 	if (fpath == "-") {
-		return read(std::cin);
-	} else {
-		std::ifstream in(fpath);
-		bool success = read(in);
-		in.close();
-		return success;
+		file->open(std::cin);
+		return readFile(file);
+	}
+	// A patch has to identify the original bytes, and unselected tracks are
+	// written from them, which the cache does not hold
+	if (useCache && !edits.enabled && selectedTracks.none() && cache::load(*this, fpath)) {
+		source.reset();
+		DIAG(log, diag::SEVERITY_DEBUG, "cache", TrackId(), diag::NO_TICK, "Read cache " << cache::path(fpath));
+		return true;
 	}
+	if (!file->open(fpath)) {
+		DIAG(log, diag::SEVERITY_ERROR, "open", TrackId(), diag::NO_TICK, "Could not open file: " << fpath);
+		return false;
+	}
+	bool success = readFile(file);
+
+	// Only a complete, clean parse is worth caching
+	if (useCache && success && !lazy && selectedTracks.none() && !cache::save(*this, fpath))
+		DIAG(log, diag::SEVERITY_WARNING, "cache", TrackId(), diag::NO_TICK,
+				"Could not write cache " << cache::path(fpath));
+	return success;
 }
 
 bool Chart::read(std::istream& in) {
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	file->open(in);
+	return readFile(file);
+}
+
+bool Chart::readFile(std::shared_ptr<MappedFile> file) {
+	source = file;
+	StrView text(source->data(), source->data() + source->size());
+	if (edits.enabled) {
+		edits.sourceSize = text.size();
+		edits.sourceHash = fnv1a(text.begin(), text.size());
+	}
+	bool success = index(text);
+
+	// Metadata sections are always parsed up front, note tracks only if
+	// they are selected and parsing is not deferred
+	if (!parseSections(text, lazy))
+		success = false;
+	if (!lazy)
+		source.reset();
+	return success;
+}
+
+bool Chart::parse(StrView text) {
+	source.reset();
+	bool success = index(text);
+	if (!parseSections(text, false))
+		success = false;
+	return success;
+}
+
+bool Chart::load(TrackId track) {
+	if (!source)
+		return true; // Everything that will ever be parsed already has been
+	StrView text(source->data(), source->data() + source->size());
+	bool success = true;
+	for (ChartSection& sec : sections) {
+		if (sec.loaded || sec.track != track)
+			continue;
+		if (!parseNoteSection(text.substr(sec.begin, sec.end - sec.begin), track, noteTracks[track.index()],
+				strings, log))
+			success = false;
+		sec.loaded = true;
+	}
+	return success;
+}
+
+bool Chart::loadAll() {
+	if (!source)
+		return true;
+	StrView text(source->data(), source->data() + source->size());
+	bool success = parseSections(text, false);
+	source.reset(); // Nothing left to parse, release the file
+	return success;
+}
+
+namespace {
+	/**
+	 * A note section parsed off the main thread, waiting to be merged into
+	 * the chart.
+	 */
+	struct ParsedNoteSection {
+		ParsedNoteSection() : done(false), success(false) {}
+		NoteTrack track;
+		/** Event text of `track`, merged into the chart's pool with it */
+		StringPool strings;
+		/** Diagnostics, held back so they can be merged in file order */
+		diag::Log log;
+		bool done;
+		bool success;
+	};
+}
+
+bool Chart::parseSections(StrView text, bool deferNoteSections) {
+	// Note sections do not depend on each other or on the rest of the chart,
+	// so they can be parsed concurrently into their own containers
+	std::vector<ParsedNoteSection> parsed;
+	std::vector<size_t> work;
+	if (threads > 1 && !deferNoteSections) {
+		for (size_t i = 0; i < sections.size(); i++) {
+			const ChartSection& sec = sections[i];
+			if (!sec.loaded && sec.track.valid() && isSelected(sec.track))
+				work.push_back(i);
+		}
+	}
+	if (work.size() > 1) {
+		// Start the largest sections first so that none of them is left
+		// running on its own at the end
+		std::sort(work.begin(), work.end(), [this](size_t a, size_t b) {
+			return sections[a].end - sections[a].begin > sections[b].end - sections[b].begin;
+		});
+		parsed.resize(sections.size());
+		parallelFor(work.size(), threads, [&](size_t w) {
+			const ChartSection& sec = sections[work[w]];
+			ParsedNoteSection& result = parsed[work[w]];
+			result.log.minSeverity = log.minSeverity;
+			result.success = parseNoteSection(text.substr(sec.begin, sec.end - sec.begin), sec.track,
+					result.track, result.strings, result.log);
+			result.done = true;
+		});
+	}
+
+	// Parse everything else and merge in the parsed note sections, in file
+	// order so that diagnostics do not depend on thread scheduling
+	bool success = true;
+	for (size_t i = 0; i < sections.size(); i++) {
+		ChartSection& sec = sections[i];
+		if (sec.loaded)
+			continue;
+		StrView body = text.substr(sec.begin, sec.end - sec.begin);
+		if (!isSelected(sec.track)) {
+			keepSection(sec.name, body);
+			sec.loaded = true;
+			continue;
+		}
+		if (deferNoteSections && sec.track.valid())
+			continue;
+		if (!parsed.empty() && parsed[i].done) {
+			ParsedNoteSection& result = parsed[i];
+			log.append(result.log);
+			mergeNoteSection(sec.track, result.track, result.strings);
+			if (!result.success)
+				success = false;
+		} else if (sec.track.valid()) {
+			if (!parseNoteSection(body, sec.track, noteTracks[sec.track.index()], strings, log))
+				success = false;
+		} else if (!parseSection(sec.name, body)) {
+			success = false;
+		}
+		sec.loaded = true;
+	}
+	return success;
+}
+
+void Chart::mergeNoteSection(TrackId id, NoteTrack& parsed, const StringPool& parsedStrings) {
+	NoteTrack& track = noteTracks[id.index()];
+	track.present = true;
+	if (track.notes.empty()) {
+		track.notes.swap(parsed.notes);
+	} else {
+		// The section appeared more than once: combine notes at the same time
+		// as if both blocks had been parsed one after the other
+		track.notes.merge(parsed.notes);
+	}
+	for (NoteTrackEvent evt : parsed.events) {
+		uint32_t text = 0;
+		if (evt.text != 0 && !internEventText(strings, parsedStrings.get(evt.text), text, log, id, evt.time))
+			continue;
+		evt.text = text;
+		track.events.push_back(evt);
+	}
+}
+
+bool Chart::internEventText(StringPool& strings, StrView text, uint32_t& id, diag::Log& log,
+		TrackId track, uint32_t tick) {
+	id = strings.intern(text);
+	if (id < EVENT_TEXT_IDS)
+		return true;
+	DIAG(log, diag::SEVERITY_ERROR, "too-many-strings", track, tick,
+			"More than " << EVENT_TEXT_IDS << " distinct event texts, dropped event: " << text);
+	return false;
+}
+
+bool Chart::isSelected(TrackId track) const {
+	return !track.valid() || selectedTracks.none() || selectedTracks.test(track.index());
+}
+
+void Chart::keepSection(const std::string& section, StrView body) {
+	RawSection raw = {section, body.str()};
+	rawSections.push_back(raw);
+}
+
+unsigned int Chart::sustainGap() const {
+	return min_sustain_gap > 0 ? min_sustain_gap : timing::duration(resolution, 32);
+}
+
+NoteTrack& Chart::track(TrackId id) {
+	load(id);
+	return noteTracks[id.index()];
+}
+
+/**
+ * Cut the next line out of the buffer without copying it, and advance `pos`
+ * to the start of the following line.
+ */
+StrView nextLine(const char*& pos, const char* end) {
+	const char* eol = static_cast<const char*>(memchr(pos, '\n', end - pos));
+	if (eol == nullptr)
+		eol = end;
+	StrView line = StrView(pos, eol).trim();
+	pos = (eol == end) ? eol : eol + 1;
+	return line;
+}
+
+/**
+ * Find the line holding the closing brace of the block whose body starts at
+ * `pos`. Returns the start of that line, or `end` if the block is never
+ * closed, and advances `pos` past it.
+ */
+const char* findBlockEnd(const char*& pos, const char* end) {
+	const char* c = pos;
+	while ((c = static_cast<const char*>(memchr(c, '}', end - c))) != nullptr) {
+		// The brace must be alone on its line, it may also appear in event text
+		const char* lineStart = c;
+		while (lineStart != pos && lineStart[-1] != '\n' && StrView::isSpace(lineStart[-1]))
+			--lineStart;
+		const char* lineEnd = c + 1;
+		while (lineEnd != end && *lineEnd != '\n' && StrView::isSpace(*lineEnd))
+			++lineEnd;
+		if ((lineStart == pos || lineStart[-1] == '\n') && (lineEnd == end || *lineEnd == '\n')) {
+			pos = (lineEnd == end) ? end : lineEnd + 1;
+			return lineStart;
+		}
+		c = lineEnd;
+	}
+	pos = end;
+	return end;
+}
+
+bool Chart::index(StrView text) {
 	bool errors = false;
-	bool inBlock = false;
 	std::string section;
+	sections.clear();
 
-	for (std::string line; getline(in, line);) {
-		boost::trim(line);
+	const char* pos = text.begin();
+	while (pos != text.end()) {
+		StrView line = nextLine(pos, text.end());
 
-		if (line == "")
+		if (line.empty())
 			continue; // Skip blank lines
 
-		if (!inBlock) {
-			if (section == "" && line.at(0) == '[') {
-				// Begin section header
-				if (line.at(line.length() - 1) == ']') {
-					// Section header is on its own line, usual case
-					section = line.substr(1, line.length() - 2);
-					DEBUG("SECTION HEADER: " + section);
-				} else {
-					std::cerr << "Unhandled syntax: " << line << "\r\n";
-					errors = true;
-				}
-			} else if (line == "{") {
-				// Start of section block
-				inBlock = true;
-				DEBUG("BEGIN SECTION");
+		if (section == "" && line.front() == '[') {
+			// Begin section header
+			if (line.back() == ']') {
+				// Section header is on its own line, usual case
+				section = line.substr(1, line.size() - 2).str();
+				DIAG(log, diag::SEVERITY_DEBUG, "section", TrackId(), diag::NO_TICK,
+						"SECTION HEADER: " << section);
 			} else {
-				std::cerr << "Illegal state for line: " << line << "\r\n";
+				DIAG(log, diag::SEVERITY_ERROR, "syntax", TrackId(), diag::NO_TICK,
+						"Unhandled syntax: " << line);
 				errors = true;
 			}
-			continue;
-		} else if (line == "}") {
-			// End of section block
-			inBlock = false;
+		} else if (line == "{") {
+			// Record the section body and skip straight to the end of it
+			DIAG(log, diag::SEVERITY_DEBUG, "section", TrackId(), diag::NO_TICK, "BEGIN SECTION");
+			ChartSection sec;
+			sec.name = section;
+			sec.track = TrackId::fromName(section);
+			sec.begin = pos - text.begin();
+			sec.end = findBlockEnd(pos, text.end()) - text.begin();
+			sec.loaded = false;
+			sections.push_back(sec);
 			section = "";
-			DEBUG("END SECTION");
-			continue;
+			DIAG(log, diag::SEVERITY_DEBUG, "section", TrackId(), diag::NO_TICK, "END SECTION");
 		} else {
-			if (section == SONG_SECTION) {
-				if (parseSongLine(line))
-					continue;
-			} else if (section == SYNC_TRACK_SECTION) {
-				if (parseSyncTrackLine(line))
-					continue;
-			} else if (section == EVENTS_SECTION) {
-				if (parseEventsLine(line))
-					continue;
-			} else {
-				if (isNoteSection(section)) {
-					if (parseNoteSectionLine(section, line))
-						continue;
-				} else {
-					std::cerr << "Unknown section: " << section << "\r\n";
-					errors = true;
-				}
-			}
+			DIAG(log, diag::SEVERITY_ERROR, "syntax", TrackId(), diag::NO_TICK,
+					"Illegal state for line: " << line);
+			errors = true;
 		}
-		std::cerr << "Unexpected line: " << line << "\r\n";
+	}
+	return !errors;
+}
+
+bool Chart::parseSection(const std::string& section, StrView body) {
+	TrackId track = TrackId::fromName(section);
+	if (track.valid())
+		return parseNoteSection(body, track, noteTracks[track.index()], strings, log);
+	if (section != SONG_SECTION && section != SYNC_TRACK_SECTION && section != EVENTS_SECTION) {
+		DIAG(log, diag::SEVERITY_INFO, "unknown-section", TrackId(), diag::NO_TICK,
+				"Unknown section: " << section << ", kept as it is");
+		keepSection(section, body);
+		return true;
+	}
+
+	bool errors = false;
+	const char* pos = body.begin();
+	while (pos != body.end()) {
+		StrView line = nextLine(pos, body.end());
+
+		if (line.empty())
+			continue; // Skip blank lines
+
+		if (section == SONG_SECTION) {
+			if (parseSongLine(line))
+				continue;
+		} else if (section == SYNC_TRACK_SECTION) {
+			if (parseSyncTrackLine(line))
+				continue;
+		} else if (section == EVENTS_SECTION) {
+			if (parseEventsLine(line))
+				continue;
+		}
+		DIAG(log, diag::SEVERITY_ERROR, "unexpected-line", TrackId(), diag::NO_TICK,
+				"Unexpected line: " << line);
 		errors = true;
 	}
-	if (!extractNotesFromNoteTrackEvents())
+	return !errors;
+}
+
+bool Chart::parseNoteSection(StrView body, TrackId id, NoteTrack& track, StringPool& strings,
+		diag::Log& log) {
+	bool errors = false;
+	track.present = true;
+	// Notes out of time order, inserted once the section ends so that an
+	// unsorted section does not shift the column for each of them
+	std::vector<Note> late;
+	const char* pos = body.begin();
+	while (pos != body.end()) {
+		StrView line = nextLine(pos, body.end());
+
+		if (line.empty())
+			continue; // Skip blank lines
+
+		if (parseNoteSectionLine(track.notes, late, track.events, line, id, strings, log))
+			continue;
+		DIAG(log, diag::SEVERITY_ERROR, "unexpected-line", id, diag::NO_TICK, "Unexpected line: " << line);
 		errors = true;
+	}
+	if (!late.empty())
+		track.notes.insert(std::move(late));
 	return !errors;
 }
 
-bool Chart::write(std::string fpath) {
-	if (fpath == "-") {
-		std::cout << toString();
-		std::cout.flush();
-		return true;
+WriteResult Chart::write(std::string fpath) {
+	loadAll();
+	Writer out;
+	if (fpath != "-" && !out.open(fpath)) {
+		DIAG(log, diag::SEVERITY_ERROR, "write", TrackId(), diag::NO_TICK, "Cannot open " << fpath);
+		return WRITE_FAILED;
 	}
-	// TODO
-	std::ofstream out(fpath);
-	out << toString();
-	out.flush();
-	out.close();
-	return true;
+	out.reserve(estimateSize());
+	writeSections(out);
+	if (!out.close()) {
+		DIAG(log, diag::SEVERITY_ERROR, "write", TrackId(), diag::NO_TICK, "Cannot write " << fpath);
+		return WRITE_FAILED;
+	}
+	if (out.unchanged()) {
+		DIAG(log, diag::SEVERITY_DEBUG, "write", TrackId(), diag::NO_TICK, fpath << " is unchanged");
+		return WRITE_UNCHANGED;
+	}
+	return WRITE_WRITTEN;
 }
 
-/**
- * Split a string `str` into two substrings `first` and `second` and trim the
- * whitespace from them. If `delim` is not found in `str`, `first` will equal
- * `str` after trimming and `second` will equal "".
- */
-void splitOnce(std::string& first, std::string& second, const std::string& str, char delim) {
-	const auto idx = str.find_first_of(delim);
-	if (std::string::npos != idx) {
-		first = str.substr(0, idx);
-		second = str.substr(idx + 1);
-	} else {
-		first = str.substr(0);
-		second = "";
+WriteResult Chart::writePatch(std::string fpath) {
+	Writer out;
+	if (fpath != "-" && !out.open(fpath)) {
+		DIAG(log, diag::SEVERITY_ERROR, "write", TrackId(), diag::NO_TICK, "Cannot open " << fpath);
+		return WRITE_FAILED;
+	}
+	edits.write(out);
+	if (!out.close()) {
+		DIAG(log, diag::SEVERITY_ERROR, "write", TrackId(), diag::NO_TICK, "Cannot write " << fpath);
+		return WRITE_FAILED;
+	}
+	if (out.unchanged()) {
+		DIAG(log, diag::SEVERITY_DEBUG, "write", TrackId(), diag::NO_TICK, fpath << " is unchanged");
+		return WRITE_UNCHANGED;
 	}
-	boost::trim(first);
-	boost::trim(second);
+	return WRITE_WRITTEN;
 }
 
-bool Chart::parseSongLine(const std::string& line) {
-	std::string key;
-	std::string value;
-	splitOnce(key, value, line, '=');
+bool Chart::parseSongLine(StrView line) {
+	StrView key;
+	StrView value;
+	line.splitOnce(key, value, '=');
 	if (key == "Name") {
-		name = value;
+		name = value.str();
 	} else if (key == "Artist") {
-		artist = value;
+		artist = value.str();
 	} else if (key == "Charter") {
-		charter = value;
+		charter = value.str();
 	} else if (key == "Offset") {
-		offset = stod(value);
+		return value.toDouble(offset);
 	} else if (key == "Resolution") {
-		resolution = stoi(value);
+		return value.toInt(resolution);
 	} else if (key == "Player2") {
-		player2 = value;
+		player2 = value.str();
 	} else if (key == "Difficulty") {
-		difficulty = stoi(value);
+		return value.toInt(difficulty);
 	} else if (key == "PreviewStart") {
-		previewStart = stod(value);
+		return value.toDouble(previewStart);
 	} else if (key == "PreviewEnd") {
-		previewEnd = stod(value);
+		return value.toDouble(previewEnd);
 	} else if (key == "Genre") {
-		genre = value;
+		genre = value.str();
 	} else if (key == "MediaType") {
-		mediaType = value;
+		mediaType = value.str();
 	} else if (key == "MusicStream") {
-		musicStream = value;
+		musicStream = value.str();
 	} else {
-		std::cerr << "Unknown key: " << key << "\r\n";
+		DIAG(log, diag::SEVERITY_WARNING, "unknown-key", TrackId(), diag::NO_TICK, "Unknown key: " << key);
 		return false;
 	}
 	return true;
 }
 
-bool Chart::parseSyncTrackLine(const std::string& line) {
-	std::string key;
-	std::string value;
+bool Chart::parseSyncTrackLine(StrView line) {
+	StrView key;
+	StrView value;
 
 	// Get time
-	splitOnce(key, value, line, '=');
-	int time = stoi(key);
+	line.splitOnce(key, value, '=');
+	uint32_t time;
+	if (!key.toUint(time))
+		return false;
 
 	// Get event details
-	splitOnce(key, value, value, ' ');
-	int val = stoi(value);
-	syncTrack.push_back(SyncTrackEvent(time, key, val));
+	value.splitOnce(key, value, ' ');
+	uint32_t val;
+	if (!value.toUint(val))
+		return false;
+	SyncTrackEvent evt(time, eventTypeFromName(key), val);
+	uint32_t text;
+	if (evt.type == EVENT_TYPE_OTHER) {
+		if (!internEventText(strings, key, text, log, TrackId(), time))
+			return true;
+		evt.text = text;
+	}
+	syncTrack.push_back(evt);
 	return true;
 }
 
-bool Chart::parseEventsLine(const std::string& line) {
-	std::string key;
-	std::string value;
+bool Chart::parseEventsLine(StrView line) {
+	StrView key;
+	StrView value;
 
 	// Get time
-	splitOnce(key, value, line, '=');
-	int time = stoi(key);
+	line.splitOnce(key, value, '=');
+	uint32_t time;
+	if (!key.toUint(time))
+		return false;
 
 	// Get event details
-	splitOnce(key, value, value, ' ');
+	value.splitOnce(key, value, ' ');
 	if (key == "E") {
-		events.push_back(Event(time, value));
+		uint32_t text;
+		if (internEventText(strings, value, text, log, TrackId(), time))
+			events.push_back(Event::makeText(time, text));
 		return true;
 	}
 	return false;
 }
 
 /**
- * Parse a line into a NoteEvent object and insert it into the vector
- * `noteEvents`.
+ * Parse a note section line straight into the note track. "N" lines set a
+ * bit on the note at that time, creating it if necessary; star power and
+ * track events are kept in `events`.
  */
-bool Chart::parseNoteSectionLine(const std::string& section, const std::string& line) {
-	std::string key;
-	std::string value;
+bool Chart::parseNoteSectionLine(NoteColumn& notes, std::vector<Note>& late, EventList& events,
+		StrView line, TrackId id, StringPool& strings, diag::Log& log) {
+	StrView key;
+	StrView value;
 
-	// Get time and vector associated with it
-	splitOnce(key, value, line, '=');
-	int time = stoi(key);
+	// Get time
+	line.splitOnce(key, value, '=');
+	uint32_t time;
+	if (!key.toUint(time))
+		return false;
 
 	// Parse note
-	splitOnce(key, value, value, ' ');
-	if (key == NOTE_TRACK_EVENT_TYPE_EVENT) { // "E" "some event"
-		noteTrackEvents[section].push_back(NoteTrackEvent(time, value));
+	value.splitOnce(key, value, ' ');
+	EventType type = eventTypeFromName(key);
+	if (type == EVENT_TYPE_TEXT) { // "E" "some event"
+		uint32_t text;
+		if (internEventText(strings, value, text, log, id, time))
+			events.push_back(NoteTrackEvent::makeText(time, text));
 		return true;
-	} else if (key == NOTE_TRACK_EVENT_TYPE_NOTE || key == NOTE_TRACK_EVENT_TYPE_STAR_POWER) { // "N" "5 0"
-		std::string type = key;
-		splitOnce(key, value, value, ' ');
-		noteTrackEvents[section].push_back(NoteTrackEvent(time, type, stoi(key), stoi(value)));
+	} else if (type == EVENT_TYPE_NOTE || type == EVENT_TYPE_STAR_POWER) { // "N" "5 0"
+		bool isNote = (type == EVENT_TYPE_NOTE);
+		uint32_t val;
+		uint32_t duration;
+		value.splitOnce(key, value, ' ');
+		if (!key.toUint(val) || !value.toUint(duration))
+			return false;
+		if (!isNote) {
+			events.push_back(NoteTrackEvent(time, EVENT_TYPE_STAR_POWER, val, duration));
+			return true;
+		}
+		if (val >= 32)
+			return false;
+
+		// The first "N" line at a given time sets the duration of the note.
+		// `insert` keeps the existing duration, and the first of the batch.
+		if (notes.empty() || notes.time(notes.size() - 1) < time) {
+			notes.push_back(time, 1u << val, duration);
+		} else if (notes.time(notes.size() - 1) == time) {
+			notes.value(notes.size() - 1) |= (1u << val);
+		} else {
+			Note note;
+			note.time = time;
+			note.value = 1u << val;
+			note.duration = duration;
+			late.push_back(note);
+		}
 		return true;
 	} else {
-		std::cerr << "Unrecognised key when parsing note section line: " << key << "\r\n";
+		DIAG(log, diag::SEVERITY_ERROR, "unknown-key", id, time,
+				"Unrecognised key when parsing note section line: " << key);
 	}
 	return false;
 }
 
-bool Chart::extractNotesFromNoteTrackEvents() {
-	bool errors = false;
-	// Iterate over map keys, which are note section names
-	for (const auto& it : noteTrackEvents) {
-		// Get the note map for this section
-		std::string section = it.first;
-		std::vector<NoteTrackEvent> filteredNteVec; // Will replace noteTrackEvents[sectiom] after notes are removed
-
-		// Filter actual notes out of the map: insert notes into `noteTrackNotes` and retain
-		// other events in `noteTrackEvents`.
-		for (const NoteTrackEvent& evt : noteTrackEvents[section]) {
-			if (!evt.isNote()) {
-				// Keep non-note event in `noteTrackEvents`
-				filteredNteVec.push_back(evt);
-			} else {
-				// Parse note, setting the value bits, and insert into `noteTrackNotes`
-				if (noteTrackNotes[section].find(evt.time) == noteTrackNotes[section].end()) {
-					Note note;
-					note.time = evt.time;
-					note.duration = evt.duration;
-					note.value = 0;
-					note.value |= (1 << evt.value);
-					noteTrackNotes[section][evt.time] = note;
-				} else {
-					noteTrackNotes[section][evt.time].value |= (1 << evt.value);
-				}
-			}
-		}
-		// Replace `noteTrackEvents[section]` with filtered vector
-		noteTrackEvents[section] = filteredNteVec;
+std::string Chart::toString() {
+	loadAll();
+	std::string str;
+	{
+		Writer out(str);
+		out.reserve(estimateSize());
+		writeSections(out);
 	}
-	return !errors;
+	return str;
 }
 
-bool isNoteSection(const std::string& section) {
-	return ((boost::starts_with(section, "Easy")
-			|| boost::starts_with(section, "Medium")
-			|| boost::starts_with(section, "Hard")
-			|| boost::starts_with(section, "Expert"))
-			&&
-			(boost::ends_with(section, "Single")
-			|| boost::ends_with(section, "DoubleGuitar")
-			|| boost::ends_with(section, "DoubleBass")
-			|| boost::ends_with(section, "EnhancedGuitar")
-			|| boost::ends_with(section, "CoopLead")
-			|| boost::ends_with(section, "CoopBass")
-			|| boost::ends_with(section, "10KeyGuitar")
-			|| boost::ends_with(section, "Drums")
-			|| boost::ends_with(section, "DoubleDrums")
-			|| boost::ends_with(section, "Vocals")
-			|| boost::ends_with(section, "Keyboard")));
-}
+void Chart::writeSections(Writer& out) {
+	writeSongSection(out);
+	writeSyncTrackSection(out);
+	writeEventsSection(out);
 
-std::string Chart::toString() {
-	std::stringstream ss;
-	ss << "[" << SONG_SECTION << "]" << "\r\n" << "{" << "\r\n";
-	ss << '\t' << "Name" << " = " << name << "\r\n";
-	ss << '\t' << "Artist" << " = " << artist << "\r\n";
-	ss << '\t' << "Charter" << " = " << charter << "\r\n";
-	ss << '\t' << "Offset" << " = " << offset << "\r\n";
-	ss << '\t' << "Resolution" << " = " << resolution << "\r\n";
-	ss << '\t' << "Player2" << " = " << player2 << "\r\n";
-	ss << '\t' << "Difficulty" << " = " << difficulty << "\r\n";
-	ss << '\t' << "PreviewStart" << " = " << previewStart << "\r\n";
-	ss << '\t' << "PreviewEnd" << " = " << previewEnd << "\r\n";
-	ss << '\t' << "Genre" << " = " << genre << "\r\n";
-	ss << '\t' << "MediaType" << " = " << mediaType << "\r\n";
-	ss << '\t' << "MusicStream" << " = " << musicStream << "\r\n";
-	ss << "}" << "\r\n";
-
-	ss << "[" << SYNC_TRACK_SECTION << "]" << "\r\n" << "{" << "\r\n";
-	std::sort(syncTrack.begin(), syncTrack.end());
-	for (const SyncTrackEvent& evt : syncTrack) {
-		ss << '\t' << evt.toEventString() << "\r\n";
-	}
-	ss << "}" << "\r\n";
-
-	ss << "[" << EVENTS_SECTION << "]" << "\r\n" << "{" << "\r\n";
-	std::sort(events.begin(), events.end());
-	for (const Event& evt : events) {
-		ss << '\t' << evt.toEventString() << "\r\n";
-	}
-	ss << "}" << "\r\n";
-
-	// Iterate over each note section
-	std::vector<NoteTrackEvent> merged;
-	for (const auto& itr0 : noteTrackNotes) {
-		std::string section = itr0.first;
-		mergeEvents(merged, noteTrackEvents[section], noteTrackNotes[section]);
-
-		ss << "[" << section << "]" << "\r\n" << "{" << "\r\n";
-		std::sort(merged.begin(), merged.end());
-		for (const NoteTrackEvent& nte : merged) {
-			ss << '\t' << nte.toEventString() << "\r\n";
-		}
-		ss << "}" << "\r\n";
-		
-		merged.clear();
+	std::vector<unsigned int> present;
+	for (unsigned int i = 0; i < TrackId::COUNT; i++) {
+		if (noteTracks.get(i).present)
+			present.push_back(i);
+	}
+	if (threads <= 1 || present.size() <= 1) {
+		for (unsigned int i : present)
+			writeNoteSection(out, TrackId(i));
+		writeRawSections(out);
+		return;
 	}
 
-	return ss.str();
+	// Format each note section into its own buffer concurrently, then write
+	// the buffers in section order. Sorting may unshare a track, so it is
+	// done beforehand to leave the workers read-only access to the chart.
+	for (unsigned int i : present) {
+		if (!noteTracks.get(i).events.sorted())
+			noteTracks[i].events.sort(strings);
+	}
+	std::vector<std::string> buffers(present.size());
+	parallelFor(present.size(), threads, [&](size_t p) {
+		Writer section(buffers[p]);
+		section.reserve(estimateSize(noteTracks.get(present[p])));
+		writeNoteSection(section, TrackId(present[p]));
+	});
+	for (const std::string& buffer : buffers)
+		out.put(buffer);
+	writeRawSections(out);
+}
+
+/** Lines are rarely longer than this, e.g. "\t123456 = N 0 192\r\n" */
+static const size_t LINE_SIZE = 20;
+
+size_t Chart::estimateSize() const {
+	size_t size = 1024 + (syncTrack.size() + events.size()) * LINE_SIZE;
+	for (const RawSection& raw : rawSections)
+		size += raw.name.size() + raw.body.size() + 8;
+	for (const NoteTrack& track : noteTracks)
+		size += estimateSize(track);
+	return size;
+}
+
+size_t Chart::estimateSize(const NoteTrack& track) {
+	return 64 + (track.notes.size() + track.events.size()) * LINE_SIZE;
+}
+
+/** Write the opening of a section, i.e. "[name]" and its opening brace */
+static void writeSectionHeader(Writer& out, StrView name) {
+	out.put('[').put(name).put("]\r\n{\r\n");
+}
+
+/** Write the closing brace of a section */
+static void writeSectionFooter(Writer& out) {
+	out.put("}\r\n");
 }
 
-void Chart::mergeEvents(std::vector<NoteTrackEvent>& out, const std::vector<NoteTrackEvent>& nte,
-		const std::map<uint32_t, Note>& notes) {
-	for (const NoteTrackEvent& evt : nte) {
-		out.push_back(evt);
+/** Write a line of [Song], i.e. "\tkey = " followed by the value */
+static Writer& writeKey(Writer& out, StrView key) {
+	return out.put('\t').put(key).put(" = ");
+}
+
+/** Write an event as a line of a section */
+static void writeEventLine(Writer& out, const Event& evt, const StringPool& strings) {
+	out.put('\t');
+	evt.write(out, strings);
+	out.put("\r\n");
+}
+
+/** Write the lines of a sorted event list */
+static void writeEventLines(Writer& out, const EventList& events, const StringPool& strings) {
+	for (const Event& evt : events)
+		writeEventLine(out, evt, strings);
+}
+
+void Chart::writeSongSection(Writer& out) {
+	writeSectionHeader(out, SONG_SECTION);
+	writeKey(out, "Name").put(name).put("\r\n");
+	writeKey(out, "Artist").put(artist).put("\r\n");
+	writeKey(out, "Charter").put(charter).put("\r\n");
+	writeKey(out, "Offset").putDouble(offset).put("\r\n");
+	writeKey(out, "Resolution").putSigned(resolution).put("\r\n");
+	writeKey(out, "Player2").put(player2).put("\r\n");
+	writeKey(out, "Difficulty").putSigned(difficulty).put("\r\n");
+	writeKey(out, "PreviewStart").putDouble(previewStart).put("\r\n");
+	writeKey(out, "PreviewEnd").putDouble(previewEnd).put("\r\n");
+	writeKey(out, "Genre").put(genre).put("\r\n");
+	writeKey(out, "MediaType").put(mediaType).put("\r\n");
+	writeKey(out, "MusicStream").put(musicStream).put("\r\n");
+	writeSectionFooter(out);
+}
+
+void Chart::writeSyncTrackSection(Writer& out) {
+	writeSectionHeader(out, SYNC_TRACK_SECTION);
+	syncTrack.sort(strings);
+	writeEventLines(out, syncTrack, strings);
+	writeSectionFooter(out);
+}
+
+void Chart::writeEventsSection(Writer& out) {
+	writeSectionHeader(out, EVENTS_SECTION);
+	events.sort(strings);
+	writeEventLines(out, events, strings);
+	writeSectionFooter(out);
+}
+
+void Chart::writeNoteLines(Writer& out, const NoteTrack& track, const Timeline& timeline) const {
+	const EventList& events = track.events;
+	const NoteColumn& notes = track.notes;
+	// Steps not yet applied to the track are applied as it is written. They
+	// keep ticks in order, so the merge below can compare unmapped ticks.
+	size_t from = std::min(track.retimed, timeline.size());
+	// Notes and events are both in order, so they are merged as they are
+	// written. At the time of a note, "E" events sort before its "N" lines
+	// and "S" events after them.
+	size_t e = 0;
+	for (size_t i = 0; i < notes.size(); i++) {
+		uint32_t time = notes.time(i);
+		for (; e < events.size() && (events[e].time < time
+				|| (events[e].time == time && events[e].type < EVENT_TYPE_NOTE)); e++)
+			writeEventLine(out, timeline.map(events[e], from), strings);
+		timeline.map(notes.note(i), from).write(out);
 	}
-	for (auto const& itr : notes) {
-		uint32_t time = itr.first;
-		const Note& note = notes.at(time);
-		note.toNoteTrackEvents(out);
+	for (; e < events.size(); e++)
+		writeEventLine(out, timeline.map(events[e], from), strings);
+}
+
+void Chart::writeNoteSection(Writer& out, TrackId track) {
+	// Only unshare the track if its events actually need sorting
+	if (!noteTracks.get(track.index()).events.sorted())
+		noteTracks[track.index()].events.sort(strings);
+	const NoteTrack& noteTrack = noteTracks.get(track.index());
+
+	writeSectionHeader(out, track.name());
+	writeNoteLines(out, noteTrack, timeline);
+	writeSectionFooter(out);
+}
+
+void Chart::writeRawSections(Writer& out) {
+	for (const RawSection& raw : rawSections) {
+		writeSectionHeader(out, raw.name);
+		TrackId id = TrackId::fromName(raw.name);
+		if (id.valid() && !timeline.empty()) {
+			// An unselected note track still has to move with the rest of
+			// the chart. Its diagnostics were not asked for, so are dropped.
+			NoteTrack track;
+			diag::Log ignored;
+			parseNoteSection(raw.body, id, track, strings, ignored);
+			track.events.sort(strings);
+			writeNoteLines(out, track, timeline);
+		} else {
+			out.put(raw.body);
+		}
+		writeSectionFooter(out);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iterator>
+
+#include "diag.h"
+
+void writeJsonString(std::ostream& out, const std::string& str);
+
+diag::Log::Log() :
+minSeverity(SEVERITY_INFO) {
+}
+
+void diag::Log::add(Severity severity, const char* code, TrackId track, uint32_t tick,
+		const std::string& message) {
+	Record record;
+	record.severity = severity;
+	record.code = code;
+	record.track = track;
+	record.tick = tick;
+	record.message = message;
+	records.push_back(record);
+}
+
+void diag::Log::append(Log& other) {
+	records.insert(records.end(), std::make_move_iterator(other.records.begin()),
+			std::make_move_iterator(other.records.end()));
+	other.records.clear();
+}
+
+void diag::Log::flush(std::ostream& out, Format format) {
+	std::ostringstream ss;
+	for (const Record& record : records) {
+		if (format == FORMAT_JSON) {
+			ss << "{\"file\":";
+			writeJsonString(ss, file);
+			ss << ",\"severity\":\"" << severityName(record.severity) << "\"";
+			ss << ",\"code\":\"" << record.code << "\"";
+			if (record.track.valid())
+				ss << ",\"track\":\"" << record.track.name() << "\"";
+			if (record.tick != NO_TICK)
+				ss << ",\"tick\":" << record.tick;
+			ss << ",\"message\":";
+			writeJsonString(ss, record.message);
+			ss << "}" << "\n";
+		} else {
+			if (file != "")
+				ss << file << ": ";
+			ss << severityName(record.severity) << ": ";
+			if (record.track.valid())
+				ss << "[" << record.track.name() << "] ";
+			ss << record.message << "\r\n";
+		}
+	}
+	out << ss.str();
+	out.flush();
+	records.clear();
+}
+
+const char* diag::severityName(Severity severity) {
+	switch (severity) {
+	case SEVERITY_DEBUG:
+		return "debug";
+	case SEVERITY_INFO:
+		return "info";
+	case SEVERITY_WARNING:
+		return "warning";
+	case SEVERITY_ERROR:
+		return "error";
+	}
+	return "";
+}
+
+bool diag::parseSeverity(const std::string& name, Severity& severity) {
+	for (int s = SEVERITY_DEBUG; s <= SEVERITY_ERROR; s++) {
+		if (name == severityName(static_cast<Severity>(s))) {
+			severity = static_cast<Severity>(s);
+			return true;
+		}
+	}
+	return false;
+}
+
+void writeJsonString(std::ostream& out, const std::string& str) {
+	static const char* hex = "0123456789abcdef";
+	out << '"';
+	for (char c : str) {
+		switch (c) {
+		case '"':
+			out << "\\\"";
+			break;
+		case '\\':
+			out << "\\\\";
+			break;
+		case '\n':
+			out << "\\n";
+			break;
+		case '\r':
+			out << "\\r";
+			break;
+		case '\t':
+			out << "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				out << "\\u00" << hex[(c >> 4) & 0xF] << hex[c & 0xF];
+			else
+				out << c;
+		}
+	}
+	out << '"';
+}
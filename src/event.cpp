@@ -17,130 +17,67 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <iostream>
-#include <sstream>
 #include <bitset>
 #include <set>
 
 #include "fix.h"
 #include "event.h"
 
-Event::Event(uint32_t time, std::string text) :
-Event(time, "E", text) {
-}
-
-Event::Event(uint32_t time, std::string type, std::string text) :
-time(time), type(type), text(text) {
-}
-
-Event::~Event() {
-}
-
-std::string Event::toEventString() const {
-	std::stringstream ss;
-	ss << time << " = " << type << " " << text;
-	return ss.str();
-}
-
-bool operator<(const Event& e0, const Event& e1) {
-	if (e0.time < e1.time)
-		return true;
-	if (e0.time == e1.time) {
-		if (e0.type < e1.type)
-			return true;
-		if (e0.type == e1.type)
-			return (e0.text < e1.text);
+EventType eventTypeFromName(StrView name) {
+	for (int t = 0; t < EVENT_TYPE_OTHER; t++) {
+		if (name == EVENT_TYPE_NAMES[t])
+			return static_cast<EventType>(t);
 	}
-	return false;
-}
-
-SyncTrackEvent::SyncTrackEvent(uint32_t time, std::string type,
-		uint32_t value) :
-Event(time, type, ""), value(value) {
-}
-
-SyncTrackEvent::~SyncTrackEvent() {
+	return EVENT_TYPE_OTHER;
 }
 
-std::string SyncTrackEvent::toEventString() const {
-	std::stringstream ss;
-	ss << time << " = " << type << " " << value;
-	return ss.str();
+Event Event::makeText(uint32_t time, uint32_t text) {
+	Event evt(time, EVENT_TYPE_TEXT, 0);
+	evt.text = text;
+	return evt;
 }
 
-bool SyncTrackEvent::isTempoChange() const {
-	return type == SYNC_TRACK_EVENT_TYPE_TEMPO;
+StrView Event::typeName(const StringPool& strings) const {
+	if (type == EVENT_TYPE_OTHER)
+		return strings.get(text);
+	return StrView(EVENT_TYPE_NAMES[type]);
 }
 
-bool SyncTrackEvent::isTsChange() const {
-	return type == SYNC_TRACK_EVENT_TYPE_TIMESIG;
-}
-
-bool operator<(const SyncTrackEvent& e0, const SyncTrackEvent& e1) {
-	if (e0.time < e1.time)
-		return true;
-	if (e0.time == e1.time) {
-		if (e0.type < e1.type)
-			return true;
-		if (e0.type == e1.type)
-			return (e0.value < e1.value);
+void Event::write(Writer& out, const StringPool& strings) const {
+	out.putUnsigned(time).put(" = ").put(typeName(strings)).put(' ');
+	switch (type) {
+	case EVENT_TYPE_TEXT:
+		out.put(strings.get(text));
+		break;
+	case EVENT_TYPE_NOTE:
+	case EVENT_TYPE_STAR_POWER:
+		out.putUnsigned(value).put(' ').putUnsigned(duration);
+		break;
+	default:
+		out.putUnsigned(value);
 	}
-	return false;
 }
 
-NoteTrackEvent::NoteTrackEvent(uint32_t time, std::string text) :
-Event(time, text), value(0), duration(0) {
-}
-
-NoteTrackEvent::NoteTrackEvent(uint32_t time, uint32_t value, uint32_t duration) :
-NoteTrackEvent(time, NOTE_TRACK_EVENT_TYPE_NOTE, value, duration) {
-}
-
-NoteTrackEvent::NoteTrackEvent(uint32_t time, std::string type, uint32_t value, uint32_t duration) :
-Event(time, type, ""), value(value), duration(duration) {
-}
-
-NoteTrackEvent::~NoteTrackEvent() {
-}
-
-std::string NoteTrackEvent::toEventString() const {
-	if (isEvent()) {
-		return Event::toEventString();
+std::string Event::toEventString(const StringPool& strings) const {
+	std::string str;
+	{
+		Writer out(str);
+		write(out, strings);
 	}
-	std::stringstream ss;
-	ss << time << " = " << type << " " << value << " " << duration;
-	return ss.str();
-}
-
-bool NoteTrackEvent::isEvent() const {
-	return type == NOTE_TRACK_EVENT_TYPE_EVENT;
-}
-
-bool NoteTrackEvent::isNote() const {
-	return type == NOTE_TRACK_EVENT_TYPE_NOTE;
-}
-
-bool NoteTrackEvent::isFlag() const {
-	return isNote() && value > NOTE_FLAG_VAL_ORANGE;
+	return str;
 }
 
-bool NoteTrackEvent::isStarPower() const {
-	return type == NOTE_TRACK_EVENT_TYPE_STAR_POWER;
-}
-
-bool operator<(const NoteTrackEvent& nte0, const NoteTrackEvent& nte1) {
-	if (nte0.time < nte1.time)
-		return true;
-	if (nte0.time == nte1.time) {
-		if (nte0.type < nte1.type)
-			return true;
-		if (nte0.type == nte1.type) {
-			if (nte0.text < nte1.text)
-				return true;
-			if (nte0.text == nte1.text)
-				return (nte0.value < nte1.value);
-		}
+bool EventLess::operator()(const Event& e0, const Event& e1) const {
+	if (e0.time != e1.time)
+		return e0.time < e1.time;
+	if (e0.type != e1.type) {
+		if (e0.type != EVENT_TYPE_OTHER && e1.type != EVENT_TYPE_OTHER)
+			return e0.type < e1.type;
+		return e0.typeName(strings) < e1.typeName(strings);
 	}
-	return false;
+	if (e0.text != e1.text)
+		return strings.get(e0.text) < strings.get(e1.text);
+	return e0.value < e1.value;
 }
 
 Note::Note() {
@@ -158,19 +95,21 @@ bool Note::isForce() const {
 }
 
 bool Note::equalsPlayable(const Note& note) const {
-	return (value & note.value & 0x1F) == 0x1F;
+	return (value & note.value & NOTE_LANE_MASK) == NOTE_LANE_MASK;
 }
 
-void Note::toNoteTrackEvents(std::vector<NoteTrackEvent>& vec) const {
-	// Write each of the active note flags out
-	for (unsigned int b = 0; b < 32; b++) {
+void Note::write(Writer& out) const {
+	// Write each of the active note flags out, straight from the bitmask
+	for (unsigned int b = 0; b < 32 && (value >> b) != 0; b++) {
 		if (!((value >> b) & 1))
 			continue;
+		out.put('\t').putUnsigned(time).put(" = N ").putUnsigned(b).put(' ');
 		// Set duration to 0 for non-playable note flags
 		if (b > NOTE_FLAG_VAL_ORANGE && b != NOTE_FLAG_VAL_OPEN)
-			vec.push_back(NoteTrackEvent(time, b, 0));
+			out.put('0');
 		else
-			vec.push_back(NoteTrackEvent(time, b, duration));
+			out.putUnsigned(duration);
+		out.put("\r\n");
 	}
 }
 
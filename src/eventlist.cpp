@@ -0,0 +1,116 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+
+#include "eventlist.h"
+
+/**
+ * True if `e1` can certainly follow `e0`, judged without looking up any
+ * text. Cases that would need the text are reported as false.
+ */
+bool inOrder(const Event& e0, const Event& e1);
+
+Event& EventList::at(size_t i) {
+	markDirty(i, i + 1);
+	return events[i];
+}
+
+void EventList::clear() {
+	events.clear();
+	dirtyBegin = 0;
+	dirtyEnd = 0;
+}
+
+void EventList::assign(std::vector<Event>& other) {
+	events.swap(other);
+	dirtyBegin = 0;
+	dirtyEnd = 0;
+	for (size_t i = 1; i < events.size(); i++) {
+		if (!inOrder(events[i - 1], events[i]))
+			markDirty(i - 1, i + 1);
+	}
+}
+
+size_t EventList::lowerBound(uint32_t tick) const {
+	return std::lower_bound(events.begin(), events.end(), tick, [](const Event& evt, uint32_t t) {
+		return evt.time < t;
+	}) - events.begin();
+}
+
+void EventList::push_back(const Event& evt) {
+	events.push_back(evt);
+	if (events.size() > 1 && !inOrder(events[events.size() - 2], evt))
+		markDirty(events.size() - 2, events.size());
+}
+
+void EventList::insert(const Event& evt, const StringPool& strings) {
+	if (!sorted()) {
+		push_back(evt);
+		return;
+	}
+	events.insert(std::upper_bound(events.begin(), events.end(), evt, EventLess(strings)), evt);
+}
+
+void EventList::shift(uint32_t delta, size_t first) {
+	for (size_t i = first; i < events.size(); i++)
+		events[i].time += delta;
+}
+
+void EventList::sort(const StringPool& strings) {
+	if (sorted())
+		return;
+	EventLess less(strings);
+	auto first = events.begin() + dirtyBegin;
+	auto last = events.begin() + dirtyEnd;
+	std::sort(first, last, less);
+	// Merge the sorted range with the untouched events on either side,
+	// skipping a merge where the boundary is already in order
+	if (first != events.begin() && less(*first, *(first - 1)))
+		std::inplace_merge(events.begin(), first, last, less);
+	if (last != events.end() && less(*last, *(last - 1)))
+		std::inplace_merge(events.begin(), last, events.end(), less);
+	dirtyBegin = 0;
+	dirtyEnd = 0;
+}
+
+void EventList::swap(EventList& other) {
+	events.swap(other.events);
+	std::swap(dirtyBegin, other.dirtyBegin);
+	std::swap(dirtyEnd, other.dirtyEnd);
+}
+
+void EventList::markDirty(size_t first, size_t last) {
+	if (sorted()) {
+		dirtyBegin = first;
+		dirtyEnd = last;
+	} else {
+		dirtyBegin = std::min(dirtyBegin, first);
+		dirtyEnd = std::max(dirtyEnd, last);
+	}
+}
+
+bool inOrder(const Event& e0, const Event& e1) {
+	if (e0.time != e1.time)
+		return e0.time < e1.time;
+	if (e0.type != e1.type)
+		return e0.type != EVENT_TYPE_OTHER && e1.type != EVENT_TYPE_OTHER && e0.type < e1.type;
+	if (e0.text != e1.text)
+		return false;
+	return e0.value <= e1.value;
+}
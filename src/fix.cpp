@@ -16,73 +16,259 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
-#include <iostream>
-#include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <sstream>
 
-#include "FeedBack.h"
 #include "fix.h"
+#include "intervalindex.h"
+#include "tempomap.h"
+#include "timing.h"
+
+namespace {
+	using namespace fix;
+
+	class StartEventPass : public Pass {
+	public:
+		StartEventPass() : Pass("start-event", PHASE_TRACK_BEGIN, 0, 0) {}
+		bool begin(Chart& chart) override {
+			fixMissingStartEvent(chart);
+			return false;
+		}
+	};
+
+	/**
+	 * Moves the note tracks through `Chart::timeline`, so the tracks are only
+	 * touched to record the shift in the patch.
+	 */
+	class LeadingMeasurePass : public Pass {
+	public:
+		LeadingMeasurePass() : Pass("leading-measure", PHASE_TRACK_BEGIN, 0,
+				ACCESS_NOTE_TIMES | ACCESS_TRACK_EVENTS), shift(0) {}
+		bool begin(Chart& chart) override {
+			shift = fixNoLeadingMeasure(chart) ? timing::duration(chart.resolution, 1) : 0;
+			return shift > 0 && chart.edits.enabled;
+		}
+		void beginTrack(TrackSweep& sweep) override {
+			sweep.edits.shift(sweep.section, 0, shift);
+		}
+	private:
+		uint32_t shift;
+	};
+
+	class StarPowerPass : public Pass {
+	public:
+		StarPowerPass() : Pass("star-power", PHASE_TRACK_BEGIN, ACCESS_NOTE_TIMES | ACCESS_TRACK_EVENTS,
+				ACCESS_TRACK_EVENTS) {}
+		void beginTrack(TrackSweep& sweep) override { fixMissingStarPower(sweep); }
+	};
+
+	class SustainGapPass : public Pass {
+	public:
+		SustainGapPass() : Pass("sustain-gap", PHASE_NOTES,
+				ACCESS_NOTE_TIMES | ACCESS_NOTE_DURATIONS | ACCESS_NOTE_LANES, ACCESS_NOTE_DURATIONS),
+				minGap(0) {}
+		bool begin(Chart& chart) override {
+			minGap = chart.sustainGap();
+			return true;
+		}
+		void visit(TrackSweep& sweep, size_t n) override {
+			if (n > 0)
+				fixSustainGap(sweep, n, minGap);
+		}
+	private:
+		unsigned int minGap;
+	};
+
+	/**
+	 * Only needs the last note of each track, so the end event is placed
+	 * after every other fix has moved or shortened the notes.
+	 */
+	class EndEventPass : public Pass {
+	public:
+		EndEventPass() : Pass("end-event", PHASE_TRACK_END, ACCESS_NOTE_TIMES | ACCESS_NOTE_DURATIONS, 0) {}
+		bool begin(Chart& chart) override {
+			found.fill(false);
+			return !hasEndEvent(chart);
+		}
+		void endTrack(TrackSweep& sweep) override {
+			const NoteColumn& notes = sweep.track().notes;
+			if (notes.empty())
+				return; // No notes in this section
+			lastNotes[sweep.id.index()] = sweep.note(notes.size() - 1);
+			found[sweep.id.index()] = true;
+		}
+		void end(Chart& chart) override {
+			// Find largest end time value, in track order
+			bool any = false;
+			Note endNote;
+			for (unsigned int i = 0; i < TrackId::COUNT; i++) {
+				if (found[i] && (!any || endNote.time < lastNotes[i].time))
+					endNote = lastNotes[i]; // Found new biggest time value
+				any = any || found[i];
+			}
+			// Add end note value and padding to end time
+			if (any)
+				addEndEvent(chart, endNote.time + endNote.duration);
+			found.fill(false);
+		}
+	private:
+		/**
+		 * The last note of each track swept. One slot per track, not a
+		 * bitset, as tracks may be swept concurrently.
+		 */
+		std::array<bool, TrackId::COUNT> found;
+		std::array<Note, TrackId::COUNT> lastNotes;
+	};
+
+	/**
+	 * The markers are interned up front, as a streamed chart only reads its
+	 * note tracks after `begin`.
+	 */
+	class SetNoteFlagsPass : public Pass {
+	public:
+		SetNoteFlagsPass() : Pass("note-flags", PHASE_TRACK_END,
+				ACCESS_NOTE_TIMES | ACCESS_NOTE_LANES | ACCESS_NOTE_FLAGS | ACCESS_TRACK_EVENTS,
+				ACCESS_NOTE_LANES | ACCESS_NOTE_FLAGS | ACCESS_TRACK_EVENTS) {}
+		bool begin(Chart& chart) override {
+			internNoteFlagEvents(chart);
+			markers = MarkerTable(chart);
+			return !chart.noteFlagMarkers.empty();
+		}
+		void endTrack(TrackSweep& sweep) override { setNoteFlags(sweep, markers); }
+	private:
+		MarkerTable markers;
+	};
+
+	class UnsetNoteFlagsPass : public Pass {
+	public:
+		UnsetNoteFlagsPass() : Pass("feedback-flags", PHASE_NOTES,
+				ACCESS_NOTE_TIMES | ACCESS_NOTE_LANES | ACCESS_NOTE_FLAGS,
+				ACCESS_NOTE_LANES | ACCESS_NOTE_FLAGS | ACCESS_TRACK_EVENTS) {}
+		bool begin(Chart& chart) override {
+			internNoteFlagEvents(chart);
+			markers = MarkerTable(chart);
+			return !chart.noteFlagMarkers.empty();
+		}
+		void visit(TrackSweep& sweep, size_t n) override { unsetNoteFlags(sweep, n, markers); }
+	private:
+		MarkerTable markers;
+	};
+
+	template <typename T>
+	std::unique_ptr<Pass> make(const Options&) {
+		return std::unique_ptr<Pass>(new T());
+	}
+
+	std::unique_ptr<Pass> makeNoteFlags(const Options& options) {
+		if (!options.noteFlags)
+			return nullptr;
+		if (options.feedbackSafe)
+			return std::unique_ptr<Pass>(new UnsetNoteFlagsPass());
+		return std::unique_ptr<Pass>(new SetNoteFlagsPass());
+	}
+}
+
+const std::vector<fix::PassInfo>& fix::registry() {
+	// Sustains are shortened before the end event is placed, and note flags
+	// are converted last so that the fixes see the chart as it was read
+	static const std::vector<PassInfo> passes = {
+		{"fix-start", 'r', "Insert a \"section Start\" event at the start of the song if there is none",
+				&Options::startEvent, true, make<StartEventPass>},
+		{"fix-leading-measure", 'l', "Insert a blank measure before the first note, taking one"
+				" second off the offset", &Options::leadingMeasure, true, make<LeadingMeasurePass>},
+		{"fix-starpower", 'p', "Insert star power phrases into tracks that have none",
+				&Options::starPower, false, make<StarPowerPass>},
+		{"fix-sustain", 'u', "Shorten sustains that end too close to the next note, see --sustain-gap",
+				&Options::sustainGap, true, make<SustainGapPass>},
+		{"fix-end", 'e', "Insert an \"end\" event after the last note if there is none",
+				&Options::endEvent, true, make<EndEventPass>},
+		{nullptr, 0, nullptr, nullptr, false, makeNoteFlags}
+	};
+	return passes;
+}
 
 void fix::fixAll(Chart& chart) {
-	// TODO
-	fixMissingStartEvent(chart);
-	fixMissingEndEvent(chart);
-	fixNoLeadingMeasure(chart);
-
-	// For each note track
-	for (auto it : chart.noteTrackNotes) {
-		std::string section = it.first;
-		fixSustainGap(chart.noteTrackNotes[section], chart.min_sustain_gap);
+	Options options;
+	for (const PassInfo& pass : registry()) {
+		if (pass.option != nullptr)
+			options.*pass.option = pass.byDefault;
 	}
+	apply(chart, options);
+}
+
+void fix::apply(Chart& chart, const Options& options) {
+	Schedule(options).run(chart);
+}
+
+void fix::applyBase(Chart& chart, const Options& options) {
+	Options base = options;
+	base.noteFlags = false;
+	Schedule(base).run(chart);
 }
 
 /* Chart file fixes */
 void fix::fixMissingStartEvent(Chart& chart) {
 	// Return if section already exists
-	for (Event evt : chart.events)
-		if (evt.time == 0 && boost::starts_with(evt.text, "\"section"))
+	for (const Event& evt : chart.events)
+		if (evt.time == 0 && evt.isEvent() && chart.strings.get(evt.text).startsWith("\"section"))
 			return;
 
 	// Add a start section
-	chart.events.insert(chart.events.begin(), NoteTrackEvent(0, "\"section Start\""));
-	std::cerr << "Inserted start section at time 0" << "\r\n";
+	uint32_t text;
+	if (!Chart::internEventText(chart.strings, "\"section Start\"", text, chart.log, TrackId(), 0))
+		return;
+	Event start = Event::makeText(0, text);
+	chart.events.insert(start, chart.strings);
+	chart.edits.insert(EVENTS_SECTION, start, chart.strings);
+	DIAG(chart.log, diag::SEVERITY_INFO, "start-event", TrackId(), 0, "Inserted start section at time 0");
 }
 
-void fix::fixMissingEndEvent(Chart& chart) {
-	// Return if section already exists
-	for (Event evt : chart.events)
-		if (evt.text == "\"end\"")
-			return;
+bool fix::hasEndEvent(const Chart& chart) {
+	uint32_t end;
+	if (!chart.strings.find("\"end\"", end))
+		return false; // No event has this text
+	for (const Event& evt : chart.events)
+		if (evt.isEvent() && evt.text == end)
+			return true;
+	return false;
+}
 
-	// Find largest end time value
-	std::string max_section;
-	uint32_t max_time = 0;
-	for (auto e0 : chart.noteTrackNotes) {
-		std::string section = e0.first;
-		std::map<uint32_t, Note> noteTrack = chart.noteTrackNotes[section];
-		auto reverseItr = noteTrack.rbegin();
-		if (reverseItr == noteTrack.rend())
-			continue; // No notes in this section
-		if (max_time < reverseItr->first) {
-			max_time = reverseItr->first; // Found new biggest time value
-			max_section = section;
-		}
-	}
+/**
+ * Real time of `tick` from the start of the chart, as "m:ss.mmm", so that a
+ * diagnostic can be found in the audio.
+ */
+static std::string chartTime(Chart& chart, uint32_t tick) {
+	chart.syncTrack.sort(chart.strings);
+	uint64_t millis = TempoMap(chart.syncTrack, chart.resolution).tickToMicros(tick) / 1000;
+	std::ostringstream ss;
+	ss << millis / 60000 << ':' << std::setfill('0') << std::setw(2) << millis / 1000 % 60 << '.'
+			<< std::setw(3) << millis % 1000;
+	return ss.str();
+}
 
-	// Add end note value and padding to end time
-	Note& endNote = chart.noteTrackNotes[max_section][max_time];
-	max_time += endNote.duration;
-	max_time += 100; // 100 units of padding
-	chart.events.push_back(NoteTrackEvent(max_time, "\"end\""));
-	std::cerr << "Inserted end event at time " << max_time << "\r\n";
+void fix::addEndEvent(Chart& chart, uint32_t last_note_end) {
+	// 100 ticks of padding at the default resolution, scaled to the chart's
+	uint32_t padding = 100 * timing::ticksPerBeat(chart.resolution) / DEFAULT_RESOLUTION;
+	uint32_t max_time = last_note_end + padding;
+	uint32_t text;
+	if (!Chart::internEventText(chart.strings, "\"end\"", text, chart.log, TrackId(), max_time))
+		return;
+	Event end = Event::makeText(max_time, text);
+	chart.events.push_back(end);
+	chart.edits.insert(EVENTS_SECTION, end, chart.strings);
+	DIAG(chart.log, diag::SEVERITY_INFO, "end-event", TrackId(), max_time,
+			"Inserted end event at time " << max_time << " (" << chartTime(chart, max_time) << ")");
 }
 
 /* Note track fixes */
 
-void fix::fixNoLeadingMeasure(Chart& chart) {
+bool fix::fixNoLeadingMeasure(Chart& chart) {
 	/**
-	 * Shifts all note tracks, the sync track, and all events except for the
-	 * section at time 0 forwards by 1 second, and then inserts a "leading"
-	 * measure of length 1 second to the beginning of each note track.
+	 * Shifts the sync track and all events except for the section at time 0
+	 * forwards by 1 second, and then inserts a "leading" measure of length 1
+	 * second. The note tracks are shifted to match through `chart.timeline`.
 	 * 
 	 * offset value is stored to 3 d.p.
 	 */
@@ -90,95 +276,102 @@ void fix::fixNoLeadingMeasure(Chart& chart) {
 	/** Numerator of the time signature of the measure that will be inserted */
 	unsigned int insert_numerator = 1;
 	unsigned int insert_bpmT = 240000; // BPM * 1000 of the insert measure
-	const unsigned int offset_game_time = DURATION_1_1;
+	const unsigned int offset_game_time = timing::duration(chart.resolution, 1);
 	const unsigned int offset_real_time = 1; // 1 second
 
 	// const unsigned int max_bpmT = 9999000; // Limit in FeedBack
 	/// const unsigned int max_ts = 99; // Limit in FeedBack
 
 	if (chart.offset < 1) {
-		std::cerr << "Cannot fix no_leading_measure: offset is less than 1" << "\r\n";
-		return;
+		DIAG(chart.log, diag::SEVERITY_WARNING, "leading-measure", TrackId(), diag::NO_TICK,
+				"Cannot fix no_leading_measure: offset is less than 1");
+		return false;
 	}
 
 	// TODO: Don't apply if not necessary
 
 	// Correct offset
 	chart.offset -= offset_real_time; // Reduce by one second
-
-	// Shift all events forward (except for start event) by one second (game time units)
-	// TODO: Apply also to PreviewStart/PreviewEnd IFF set
-	for (SyncTrackEvent& evt : chart.syncTrack)
-		evt.time += offset_game_time;
-	for (Event& evt : chart.events) {
-		if (evt.time == 0 && boost::starts_with(evt.text, "\"section"))
-			continue; // Don't move the start event
-		evt.time += offset_game_time;
+	if (chart.edits.enabled) {
+		std::string offset;
+		Writer(offset).putDouble(chart.offset);
+		chart.edits.set(SONG_SECTION, "Offset", offset);
 	}
-	// Shift all notes forward
-	for (auto e0 : chart.noteTrackNotes) {
-		std::string section = e0.first;
-
-		// Fix note track events, which can be mutated in place
-		for (NoteTrackEvent& evt : chart.noteTrackEvents[section]) {
-			evt.time += offset_game_time;
-		}
 
-		// Build new vector for note tracks, these need rebuilding because
-		// the key mapped to each element is the time, which is what we are
-		// mutating.
-		std::vector<Note> fixedNotes;
-		for (auto e1 : chart.noteTrackNotes[section]) {
-			Note note = chart.noteTrackNotes[section][e1.first];
-			note.time += offset_game_time;
-			fixedNotes.push_back(note);
+	// Keep the preview on the same part of the chart. 0 means it is not set.
+	double* preview[] = {&chart.previewStart, &chart.previewEnd};
+	const char* previewKeys[] = {"PreviewStart", "PreviewEnd"};
+	for (size_t i = 0; i < 2; i++) {
+		if (*preview[i] == 0)
+			continue;
+		*preview[i] += offset_real_time;
+		if (chart.edits.enabled) {
+			std::string value;
+			Writer(value).putDouble(*preview[i]);
+			chart.edits.set(SONG_SECTION, previewKeys[i], value);
 		}
+	}
 
-		// Clear note map and rebuild with new vectors
-		chart.noteTrackNotes[section].clear();
-		for (Note note : fixedNotes) {
-			chart.noteTrackNotes[section][note.time] = note;
-		}
+	// Shift all events forward (except for start event) by one second (game time units)
+	chart.syncTrack.shift(offset_game_time);
+	chart.edits.shift(SYNC_TRACK_SECTION, 0, offset_game_time);
+	// [Events] may be in any order as it was read
+	chart.events.sort(chart.strings);
+	size_t later = chart.events.lowerBound(1);
+	for (size_t i = 0; i < later; i++) {
+		const Event& evt = chart.events[i];
+		if (evt.isEvent() && chart.strings.get(evt.text).startsWith("\"section"))
+			continue; // Don't move the start event
+		Event moved = evt;
+		moved.time += offset_game_time;
+		chart.edits.modify(EVENTS_SECTION, evt, moved, chart.strings);
+		chart.events.at(i).time = moved.time;
 	}
+	chart.events.shift(offset_game_time, later);
+	chart.edits.shift(EVENTS_SECTION, 1, offset_game_time);
+	// The note tracks are moved as they are next modified or written
+	chart.timeline.shift(offset_game_time);
 
 	// Add the insert measure
-	chart.syncTrack.insert(chart.syncTrack.begin(), SyncTrackEvent(0, SYNC_TRACK_EVENT_TYPE_TIMESIG,
-			insert_numerator));
-	chart.syncTrack.insert(chart.syncTrack.begin(), SyncTrackEvent(0, SYNC_TRACK_EVENT_TYPE_TEMPO,
-			insert_bpmT));
+	SyncTrackEvent timeSignature(0, EVENT_TYPE_TIMESIG, insert_numerator);
+	SyncTrackEvent tempo(0, EVENT_TYPE_TEMPO, insert_bpmT);
+	chart.syncTrack.insert(timeSignature, chart.strings);
+	chart.syncTrack.insert(tempo, chart.strings);
+	chart.edits.insert(SYNC_TRACK_SECTION, timeSignature, chart.strings);
+	chart.edits.insert(SYNC_TRACK_SECTION, tempo, chart.strings);
 
-	std::cerr << "Inserted leading measure of " << insert_numerator << "/4 at ";
-	std::cerr << (insert_bpmT / 1000) << " BPM" << "\r\n";
+	DIAG(chart.log, diag::SEVERITY_INFO, "leading-measure", TrackId(), 0,
+			"Inserted leading measure of " << insert_numerator << "/4 at " << (insert_bpmT / 1000) << " BPM");
+	return true;
 }
 
-void fix::fixSustainGap(std::map<uint32_t, Note>& noteTrack, const unsigned int min_gap) {
+void fix::fixSustainGap(TrackSweep& sweep, size_t n, unsigned int min_gap) {
 	/** If the next note is identical, should the fix still be applied? */
 	const bool apply_to_repeat_notes = false;
-	auto it = noteTrack.begin();
-	uint32_t prev_time = it->first;
-	for (++it; it != noteTrack.end(); ++it) {
-		Note& note = noteTrack[it->first];
-		Note& prev_note = noteTrack[prev_time];
-		if (prev_note.duration > 0) { // Ignore non-sustain notes
-			if ((apply_to_repeat_notes && prev_note.equalsPlayable(note))
-					|| !prev_note.equalsPlayable(note)) { // Ignore identical notes if set
-				uint32_t prev_note_end_time = prev_note.time + prev_note.duration;
-				int delta = note.time - prev_note_end_time;
-				if (delta < min_gap) {
-					std::cerr << "Sustain gap too small between " << prev_note << " and " << note << "\r\n";
-					std::cerr << "Duration changed from " << prev_note.duration << " to ";
-
-					// Do fix
-					delta = min_gap - delta;
-					if (prev_note.duration < delta)
-						delta = prev_note.duration;
-					prev_note.duration -= delta;
-
-					std::cerr << prev_note.duration << " (-" << delta << ")" << "\r\n";
-				}
+	if (sweep.track().notes.duration(n - 1) > 0) { // Ignore non-sustain notes
+		Note note = sweep.note(n);
+		Note prev_note = sweep.note(n - 1);
+		if ((apply_to_repeat_notes && prev_note.equalsPlayable(note))
+				|| !prev_note.equalsPlayable(note)) { // Ignore identical notes if set
+			uint32_t prev_note_end_time = prev_note.time + prev_note.duration;
+			int delta = note.time - prev_note_end_time;
+			if (delta < min_gap) {
+				Note old_note = prev_note;
+
+				// Do fix
+				delta = min_gap - delta;
+				if (prev_note.duration < delta)
+					delta = prev_note.duration;
+				prev_note.duration -= delta;
+				sweep.modify().notes.duration(n - 1) = prev_note.duration;
+				sweep.edits.modifyDuration(sweep.section, prev_note.time, prev_note.duration);
+
+				DIAG(sweep.log, diag::SEVERITY_INFO, "sustain-gap", sweep.id, prev_note.time,
+						"Sustain gap too small between " << old_note << " and " << note
+						<< ", duration changed from " << old_note.duration << " to " << prev_note.duration
+						<< " (-" << delta << ")");
 			}
 		}
-		prev_time = it->first;
 	}
 }
 
@@ -186,91 +379,199 @@ void fix::fixUnequalNoteDurations(std::vector<Note>& fixed, std::vector<NoteTrac
 	// TODO
 }
 
+fix::MarkerTable::MarkerTable() : flagMask(0) {
+	byFlag.fill(0);
+}
+
+fix::MarkerTable::MarkerTable(const Chart& chart) : flagMask(0) {
+	for (const NoteFlagMarker& marker : chart.noteFlagMarkers) {
+		uint32_t text;
+		if (marker.flag < byFlag.size() && chart.strings.find(marker.text, text) && text < EVENT_TEXT_IDS)
+			entries.push_back({text, marker.flag, marker.replacesLanes});
+	}
+	// Keep the first marker for each text
+	std::stable_sort(entries.begin(), entries.end(),
+			[](const Entry& a, const Entry& b) { return a.text < b.text; });
+	entries.erase(std::unique(entries.begin(), entries.end(),
+			[](const Entry& a, const Entry& b) { return a.text == b.text; }), entries.end());
+	// and the first marker for each flag, in the order they were given
+	byFlag.fill(entries.size());
+	for (const NoteFlagMarker& marker : chart.noteFlagMarkers) {
+		uint32_t text;
+		if (marker.flag >= byFlag.size() || ((flagMask >> marker.flag) & 1)
+				|| !chart.strings.find(marker.text, text) || text >= EVENT_TEXT_IDS)
+			continue;
+		const Entry* entry = find(text);
+		if (entry->flag != marker.flag)
+			continue;
+		byFlag[marker.flag] = entry - entries.data();
+		flagMask |= 1u << marker.flag;
+	}
+}
+
+const fix::MarkerTable::Entry* fix::MarkerTable::find(uint32_t text) const {
+	auto it = std::lower_bound(entries.begin(), entries.end(), text,
+			[](const Entry& entry, uint32_t text) { return entry.text < text; });
+	if (it == entries.end() || it->text != text)
+		return nullptr;
+	return &*it;
+}
+
+const fix::MarkerTable::Entry* fix::MarkerTable::forFlag(unsigned int flag) const {
+	if (flag >= byFlag.size() || byFlag[flag] == entries.size())
+		return nullptr;
+	return &entries[byFlag[flag]];
+}
+
+namespace {
+	/** Name of a note flag for diagnostics, e.g. "tap flag" */
+	std::string flagName(unsigned int flag) {
+		switch (flag) {
+		case NOTE_FLAG_VAL_HOPO_FLIP: return "HOPO flip flag";
+		case NOTE_FLAG_VAL_TAP: return "tap flag";
+		case NOTE_FLAG_VAL_OPEN: return "open note flag";
+		default: return "note flag " + std::to_string(flag);
+		}
+	}
+
+	/** The duration written on the "N" line of `flag`, see `Note::write` */
+	uint32_t flagDuration(unsigned int flag, uint32_t duration) {
+		return flag == NOTE_FLAG_VAL_OPEN ? duration : 0;
+	}
+}
+
 void fix::setNoteFlags(Chart& chart) {
+	internNoteFlagEvents(chart);
+	MarkerTable markers(chart);
 	// For each note section
-	for (auto it : chart.noteTrackNotes) {
-		const std::string section = it.first;
-		std::vector<NoteTrackEvent> filteredNte;
-		for (NoteTrackEvent& evt : chart.noteTrackEvents[section]) {
-			// Ignore non-events
-			if (!evt.isEvent()) {
-				filteredNte.push_back(evt);
-				continue;
-			}
+	sweepTracks(chart, [&](TrackSweep& sweep) { setNoteFlags(sweep, markers); });
+}
 
-			// If a note doesn't exist at this time, skip - cannot set flags for a non-existant note
-			if (chart.noteTrackNotes[section].find(evt.time) == chart.noteTrackNotes[section].end()) {
-				std::cerr << "No note for note flag event \"" << evt.toEventString() << "\"\r\n";
-				continue;
-			}
-			// Convert and add to note track
-			if (evt.text == chart.track_event_tap) {
-				// Tap event
-				chart.noteTrackNotes[section][evt.time].value |= (1 << NOTE_FLAG_VAL_TAP);
-				std::cerr << "Parsed track event \"" << evt.toEventString() << "\"";
-				std::cerr << " as tap flag" << "\r\n";
-			} else if (evt.text == chart.track_event_hopo_flip) {
-				// HOPO flip event
-				chart.noteTrackNotes[section][evt.time].value |= (1 << NOTE_FLAG_VAL_HOPO_FLIP);
-				std::cerr << "Parsed track event \"" << evt.toEventString() << "\"";
-				std::cerr << " as HOPO flip flag" << "\r\n";
-			} else {
-				// Not a flag event
-				std::cerr << "not a flag event: " << evt.text << "\r\n";
-				filteredNte.push_back(evt);
+void fix::setNoteFlags(TrackSweep& sweep, const MarkerTable& markers) {
+	Chart& chart = sweep.chart;
+	// Leave tracks without markers shared with other copies of the chart
+	const NoteTrack& shared = sweep.track();
+	if (std::none_of(shared.events.begin(), shared.events.end(),
+			[&](const NoteTrackEvent& evt) { return evt.isEvent() && markers.find(evt.text); }))
+		return;
+	NoteTrack& track = sweep.modify();
+	// Events and notes are both in time order, so one cursor into the notes
+	// follows the events along
+	track.events.sort(chart.strings);
+	size_t note = 0;
+	// Markers are converted and dropped, all other events are kept
+	track.events.eraseIf([&](const NoteTrackEvent& evt) {
+		// Ignore non-events
+		if (!evt.isEvent())
+			return false;
+		const MarkerTable::Entry* marker = markers.find(evt.text);
+		if (!marker) {
+			// Not a flag event
+			DIAG(sweep.log, diag::SEVERITY_DEBUG, "note-flag", sweep.id, evt.time,
+					"not a flag event: " << chart.strings.get(evt.text));
+			return false;
+		}
+
+		while (note < track.notes.size() && track.notes.time(note) < evt.time)
+			note++;
+		// If a note doesn't exist at this time, skip - cannot set flags for a non-existant note
+		if (note == track.notes.size() || track.notes.time(note) != evt.time) {
+			DIAG(sweep.log, diag::SEVERITY_WARNING, "note-flag", sweep.id, evt.time,
+					"No note for note flag event \"" << evt.toEventString(chart.strings) << "\"");
+			sweep.edits.erase(sweep.section, evt, chart.strings);
+			return true;
+		}
+		// Convert and add to note track
+		DIAG(sweep.log, diag::SEVERITY_INFO, "note-flag", sweep.id, evt.time,
+				"Parsed track event \"" << evt.toEventString(chart.strings) << "\" as "
+				<< flagName(marker->flag));
+		sweep.edits.erase(sweep.section, evt, chart.strings);
+		uint32_t& value = track.notes.value(note);
+		uint32_t duration = track.notes.duration(note);
+		if (marker->replacesLanes) {
+			for (unsigned int lane = 0; lane <= NOTE_FLAG_VAL_ORANGE; lane++) {
+				if ((value >> lane) & 1)
+					sweep.edits.erase(sweep.section, NoteTrackEvent(evt.time, EVENT_TYPE_NOTE, lane, duration),
+							chart.strings);
 			}
+			value &= ~NOTE_LANE_MASK;
 		}
-		chart.noteTrackEvents[section] = filteredNte;
-	}
+		if (!((value >> marker->flag) & 1))
+			sweep.edits.insert(sweep.section, NoteTrackEvent(evt.time, EVENT_TYPE_NOTE, marker->flag,
+					flagDuration(marker->flag, duration)), chart.strings);
+		value |= (1u << marker->flag);
+		return true;
+	});
 }
 
 void fix::unsetNoteFlags(Chart& chart) {
+	internNoteFlagEvents(chart);
+	MarkerTable markers(chart);
 	// For each note section
-	for (auto it : chart.noteTrackNotes) {
-		const std::string section = it.first;
-		std::map<uint32_t, Note>& notes = chart.noteTrackNotes[section];
-		// For each note
-		for (auto const& itr : notes) {
-			uint32_t time = itr.first;
-			Note& note = notes.at(time);
-			// Unset flag and add an equivilant track event
-			if (note.isTap()) {
-				note.value ^= (1 << NOTE_FLAG_VAL_TAP);
-				NoteTrackEvent evt = NoteTrackEvent(note.time, chart.track_event_tap);
-				chart.noteTrackEvents[section].push_back(evt);
-				std::cerr << "Unset tap flag and added track event \"" << evt.toEventString() << "\"\r\n";
-			}
-			if (note.isForce()) {
-				note.value ^= (1 << NOTE_FLAG_VAL_HOPO_FLIP);
-				NoteTrackEvent evt = NoteTrackEvent(note.time, chart.track_event_hopo_flip);
-				chart.noteTrackEvents[section].push_back(evt);
-				std::cerr << "Unset tap flag and added track event \"" << evt.toEventString() << "\"\r\n";
-			}
+	sweepTracks(chart, [&](TrackSweep& sweep) {
+		// Tracks without flags are only read, so they stay shared with other
+		// copies of the chart
+		for (size_t n = 0; n < sweep.track().notes.size(); n++)
+			unsetNoteFlags(sweep, n, markers);
+	});
+}
+
+void fix::internNoteFlagEvents(Chart& chart) {
+	// A marker whose id does not fit is left out of the MarkerTable
+	uint32_t text;
+	for (const NoteFlagMarker& marker : chart.noteFlagMarkers)
+		Chart::internEventText(chart.strings, marker.text, text, chart.log, TrackId(), 0);
+}
+
+void fix::unsetNoteFlags(TrackSweep& sweep, size_t n, const MarkerTable& markers) {
+	Chart& chart = sweep.chart;
+	Note note = sweep.note(n);
+	uint32_t flags = note.value & markers.flags();
+	if (!flags)
+		return;
+	NoteTrack& track = sweep.modify();
+	// Unset each flag and add an equivilant track event
+	for (unsigned int flag = 0; flags >> flag; flag++) {
+		if (!((flags >> flag) & 1))
+			continue;
+		const MarkerTable::Entry* marker = markers.forFlag(flag);
+		uint32_t& value = track.notes.value(n);
+		value &= ~(1u << flag);
+		sweep.edits.erase(sweep.section, NoteTrackEvent(note.time, EVENT_TYPE_NOTE, flag,
+				flagDuration(flag, note.duration)), chart.strings);
+		// The flag stood in for the lanes, so give the note one back
+		if (marker->replacesLanes && !(value & NOTE_LANE_MASK)) {
+			value |= (1 << NOTE_FLAG_VAL_GREEN);
+			sweep.edits.insert(sweep.section, NoteTrackEvent(note.time, EVENT_TYPE_NOTE, NOTE_FLAG_VAL_GREEN,
+					note.duration), chart.strings);
 		}
+		NoteTrackEvent evt = NoteTrackEvent::makeText(note.time, marker->text);
+		track.events.push_back(evt);
+		sweep.edits.insert(sweep.section, evt, chart.strings);
+		DIAG(sweep.log, diag::SEVERITY_INFO, "note-flag", sweep.id, note.time,
+				"Unset " << flagName(flag) << " and added track event \"" << evt.toEventString(chart.strings)
+				<< "\"");
 	}
 }
 
 /**
  * Insert x-measure-long star power phrases at y-measure-long intervals.
  */
-void fix::fixMissingStarPower(Chart& chart) {
-	// For each note section
-	for (auto it : chart.noteTrackNotes) {
-		const std::string section = it.first;
+void fix::fixMissingStarPower(TrackSweep& sweep) {
+	const NoteTrack& track = sweep.track();
 
-		// Ensure that the note event track contains no SP phrases
-		for (NoteTrackEvent& evt : chart.noteTrackEvents[section]) {
-			if (evt.isStarPower())
-				return; // Found SP phrase, stop operation
-		}
+	// Ensure that the note event track contains no SP phrases
+	IntervalIndex phrases;
+	phrases.buildPhrases(track.events, sweep.chart.timeline, track.retimed);
+	if (!phrases.empty())
+		return; // Found SP phrase, stop operation
 
-		// Generate SP phrases
-		const unsigned int phraseMeasures = 2; // How long the SP phrases should be, in measures
-		const unsigned int intervalMeasures = 6; // Space between SP phrases, in measures
-		unsigned int currentMeasure = 0;
-		for (auto it : chart.noteTrackNotes[section]) {
-			uint32_t time = it.first;
-			// TODO
-		}
+	// Generate SP phrases
+	const unsigned int phraseMeasures = 2; // How long the SP phrases should be, in measures
+	const unsigned int intervalMeasures = 6; // Space between SP phrases, in measures
+	unsigned int currentMeasure = 0;
+	for (size_t n = 0; n < track.notes.size(); n++) {
+		uint32_t time = sweep.note(n).time;
+		// TODO
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,107 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+
+#include "intervalindex.h"
+
+void IntervalIndex::clear() {
+	starts.clear();
+	ends.clear();
+	sources.clear();
+	maxEnds.clear();
+}
+
+void IntervalIndex::buildSustains(const NoteColumn& notes, const Timeline& timeline, size_t from) {
+	clear();
+	for (size_t i = 0; i < notes.size(); i++) {
+		if (notes.duration(i) == 0)
+			continue;
+		uint32_t time = timeline.map(notes.time(i), from);
+		uint32_t duration = timeline.mapDuration(notes.time(i), notes.duration(i), from);
+		push_back(time, static_cast<uint64_t>(time) + duration, i);
+	}
+	finish();
+}
+
+void IntervalIndex::buildPhrases(const EventList& events, const Timeline& timeline, size_t from) {
+	clear();
+	// Phrases are usually already in order; sort the rare exceptions by start
+	bool sorted = true;
+	for (size_t i = 0; i < events.size(); i++) {
+		if (!events[i].isStarPower() || events[i].value != 2)
+			continue;
+		Event evt = timeline.map(events[i], from);
+		if (!starts.empty() && evt.time < starts.back())
+			sorted = false;
+		starts.push_back(evt.time);
+		ends.push_back(static_cast<uint64_t>(evt.time) + evt.duration);
+		sources.push_back(i);
+	}
+	if (!sorted) {
+		std::vector<size_t> order(starts.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+			return starts[a] < starts[b];
+		});
+		std::vector<uint32_t> s(order.size()), src(order.size());
+		std::vector<uint64_t> e(order.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			s[i] = starts[order[i]];
+			e[i] = ends[order[i]];
+			src[i] = sources[order[i]];
+		}
+		starts.swap(s);
+		ends.swap(e);
+		sources.swap(src);
+	}
+	finish();
+}
+
+void IntervalIndex::stab(uint32_t tick, std::vector<uint32_t>& out) const {
+	overlapping(tick, tick, out);
+}
+
+void IntervalIndex::overlapping(uint32_t begin, uint32_t end, std::vector<uint32_t>& out) const {
+	forEachOverlap(begin, end, [this, &out](size_t i) {
+		out.push_back(sources[i]);
+	});
+}
+
+void IntervalIndex::push_back(uint32_t start, uint64_t end, uint32_t source) {
+	starts.push_back(start);
+	ends.push_back(end);
+	sources.push_back(source);
+}
+
+void IntervalIndex::finish() {
+	maxEnds.resize(starts.size());
+	fillMaxEnds(0, starts.size());
+}
+
+uint64_t IntervalIndex::fillMaxEnds(size_t first, size_t last) {
+	if (first >= last)
+		return 0;
+	size_t mid = first + (last - first) / 2;
+	uint64_t maxEnd = ends[mid];
+	maxEnd = std::max(maxEnd, fillMaxEnds(first, mid));
+	maxEnd = std::max(maxEnd, fillMaxEnds(mid + 1, last));
+	maxEnds[mid] = maxEnd;
+	return maxEnd;
+}
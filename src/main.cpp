@@ -16,19 +16,72 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <bitset>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string.h>
 #include "cmdline.h"
 
-#include "FeedBack.h"
 #include "chart.h"
-#include "debug.h"
+#include "diag.h"
 #include "fix.h"
+#include "mappedfile.h"
+#include "patch.h"
+#include "stream.h"
 
 const std::string DEFAULT_NOTE_TRACK_EVENT_TAP = "t";
 const std::string DEFAULT_NOTE_TRACK_EVENT_HOPO_FLIP = "*";
 const std::string DEFAULT_NOTE_TRACK_EVENT_OPEN_NOTE = "o";
 
+/**
+ * The file name part of `input_file`, to which output prefixes are added.
+ */
+std::string outputName(const std::string& input_file) {
+	#ifdef _WIN32
+	const char sep = '\\';
+	#else
+	const char sep = '/';
+	#endif
+	size_t idx = input_file.rfind(sep, input_file.length());
+	if (idx == std::string::npos)
+		return input_file;
+	return input_file.substr(idx + 1, input_file.length() - idx);
+}
+
+/**
+ * Apply a patch made with --patch to `input_file`, writing the result to
+ * `output_file` ("-" for stdout).
+ */
+WriteResult applyPatch(const std::string& input_file, const MappedFile& patch,
+		const std::string& output_file, diag::Log& log) {
+	MappedFile input;
+	if (input_file == "-" ? !input.open(std::cin) : !input.open(input_file)) {
+		DIAG(log, diag::SEVERITY_ERROR, "open", TrackId(), diag::NO_TICK, "Could not open file: " << input_file);
+		return WRITE_FAILED;
+	}
+	// Patch into memory first so that a patch which does not apply leaves
+	// any existing output untouched
+	std::string patched;
+	{
+		Writer text(patched);
+		if (!patch::apply(StrView(input.data(), input.data() + input.size()),
+				StrView(patch.data(), patch.data() + patch.size()), text, log))
+			return WRITE_FAILED;
+	}
+	Writer out;
+	if (output_file != "-" && !out.open(output_file)) {
+		DIAG(log, diag::SEVERITY_ERROR, "write", TrackId(), diag::NO_TICK, "Cannot open " << output_file);
+		return WRITE_FAILED;
+	}
+	out.put(patched);
+	if (!out.close()) {
+		DIAG(log, diag::SEVERITY_ERROR, "write", TrackId(), diag::NO_TICK, "Cannot write " << output_file);
+		return WRITE_FAILED;
+	}
+	return out.unchanged() ? WRITE_UNCHANGED : WRITE_WRITTEN;
+}
+
 int main(int argc, char* argv[]) {
 	cmdline::parser parser;
 	parser.footer("filename ...");
@@ -38,19 +91,46 @@ int main(int argc, char* argv[]) {
 	parser.add<std::string>("hopo-event", 'h', "The track event text that marks a HOPO flip"
 			" (force note). default: \"" + DEFAULT_NOTE_TRACK_EVENT_HOPO_FLIP + "\"", false,
 			DEFAULT_NOTE_TRACK_EVENT_HOPO_FLIP);
+	parser.add<std::string>("open-event", 'o', "The track event text that marks an open note, replacing"
+			" the lanes of the marked note. default: \"" + DEFAULT_NOTE_TRACK_EVENT_OPEN_NOTE + "\"", false,
+			DEFAULT_NOTE_TRACK_EVENT_OPEN_NOTE);
 	parser.add<unsigned int>("sustain-gap", 'g', "The minimum gap to enforce after the end"
-			" of a sustain note. default: 24 (1/32)", false, DURATION_1_32);
+			" of a sustain note, in ticks. default: 1/32 of a measure at the chart's resolution"
+			" (24 at 192)", false, 0);
 	parser.add("stdio", 's', "Read in from stdin and output to stdout");
+	parser.add("stream", 'm', "With --stdio, fix and write each section as soon as it has been"
+			" read instead of reading the whole chart first");
 	parser.add<std::string>("output-prefix", 'x', "String to prefix to output file name. default:"
 			" \"fixed_\"", false, "fixed_");
+	parser.add("both", 'w', "Write both a game-ready chart and a FeedBack-safe chart (see"
+			" --feedback-safe) from a single read of each file");
+	parser.add<std::string>("feedback-prefix", 'y', "With --both, string to prefix to the file name"
+			" of the FeedBack-safe chart. default: \"feedback_\"", false, "feedback_");
+	parser.add("patch", 'P', "Write only the edits made by the fixes, as a patch, to the output"
+			" file name with \".patch\" appended (or to stdout with --stdio)");
+	parser.add<std::string>("apply-patch", 'a', "Apply this patch, made with --patch, to the input"
+			" files instead of fixing them. The charts are not parsed. default: none", false, "");
+	parser.add<std::string>("tracks", 'k', "Comma-separated list of note tracks to process, e.g."
+			" \"ExpertSingle,ExpertDoubleBass\". Other note tracks are not parsed, and are written unchanged."
+			" default: all tracks", false, "");
+	parser.add<std::string>("log-format", 'f', "Format of diagnostics written to stderr, \"text\""
+			" or \"json\" (one object per line). default: \"text\"", false, "text",
+			cmdline::oneof<std::string>("text", "json"));
+	parser.add<std::string>("log-level", 'v', "Least severe diagnostics to report: \"debug\","
+			" \"info\", \"warning\" or \"error\". default: \"info\"", false, "info",
+			cmdline::oneof<std::string>("debug", "info", "warning", "error"));
+	parser.add("cache", 'c', "Keep a parsed copy of each chart in a binary .ctb file next to it,"
+			" and read that instead of the chart while the chart is unchanged");
+	parser.add<unsigned int>("threads", 'j', "Number of threads to use per chart, for reading,"
+			" fixing and writing note tracks. default: 1",
+			false, 1);
 	// Fixes
 	parser.add("feedback-safe", 'b', "Ensure that note flags remain as (or are converted to)"
 			" track events to ensure that the chart can still be safely edited in FeedBack");
-	parser.add("fix-start", 'r', "");
-	parser.add("fix-end", 'e', "");
-	parser.add("fix-leading-measure", 'l', "");
-	parser.add("fix-starpower", 'p', "");
-	parser.add("fix-sustain", 'u', "");
+	for (const fix::PassInfo& pass : fix::registry()) {
+		if (pass.flag != nullptr)
+			parser.add(pass.flag, pass.shortName, pass.description);
+	}
 
 	// Execute parser
 	parser.parse_check(argc, argv);
@@ -60,6 +140,13 @@ int main(int argc, char* argv[]) {
 		return 0;
 	}
 
+	// Stream mode writes each section as soon as it is fixed, before the
+	// whole source is known, so it cannot make a patch against it
+	if (parser.exist("patch") && parser.exist("stdio") && parser.exist("stream")) {
+		std::cerr << "--patch cannot be combined with --stream. See --help\r\n";
+		return 1;
+	}
+
 	// Enumerate input files
 	std::vector<std::string> input_files;
 	if (parser.rest().size() == 0) { // Positional arguments vector
@@ -75,64 +162,154 @@ int main(int argc, char* argv[]) {
 			input_files.push_back(s);
 	}
 
-	for (std::string input_file : input_files) {
-		// Parse
-		Chart chart;
-		chart.track_event_hopo_flip = parser.get <std::string>("hopo-event");
-		chart.track_event_tap = parser.get <std::string>("tap-event");
-		chart.min_sustain_gap = parser.get<unsigned int>("sustain-gap");
-		chart.read(input_file);
-
-		// Apply fixes, fix all if no specific fixes are set
-		bool fixall = true;
-		if (parser.exist("fix-start")) {
-			fix::fixMissingStarPower(chart);
-			fixall = false;
-		}
-		if (parser.exist("fix-end")) {
-			fix::fixMissingEndEvent(chart);
-			fixall = false;
+	// Enumerate selected note tracks
+	std::bitset<TrackId::COUNT> tracks;
+	std::stringstream track_list(parser.get<std::string>("tracks"));
+	for (std::string name; getline(track_list, name, ',');) {
+		if (name == "")
+			continue;
+		TrackId track = TrackId::fromName(name);
+		if (!track.valid()) {
+			std::cerr << "Unknown note track: " << name << "\r\n";
+			return 1;
 		}
-		if (parser.exist("fix-leading-measure")) {
-			fix::fixNoLeadingMeasure(chart);
-			fixall = false;
+		tracks.set(track.index());
+	}
+
+	// Diagnostics
+	diag::Format log_format = parser.get<std::string>("log-format") == "json" ? diag::FORMAT_JSON
+			: diag::FORMAT_TEXT;
+	diag::Severity log_level = diag::SEVERITY_INFO;
+	diag::parseSeverity(parser.get<std::string>("log-level"), log_level);
+
+	// Select fixes, fix all if no specific fixes are set
+	fix::Options fixes;
+	bool anyFix = false;
+	for (const fix::PassInfo& pass : fix::registry()) {
+		if (pass.flag != nullptr && parser.exist(pass.flag))
+			anyFix = fixes.*pass.option = true;
+	}
+	if (!anyFix) {
+		for (const fix::PassInfo& pass : fix::registry()) {
+			if (pass.option != nullptr)
+				fixes.*pass.option = pass.byDefault;
 		}
-		if (parser.exist("fix-starpower")) {
-			fix::fixMissingStarPower(chart);
-			fixall = false;
+	}
+	fixes.feedbackSafe = parser.exist("feedback-safe");
+
+	bool both = parser.exist("both") && !parser.exist("stdio");
+
+	// One chart is reused for every file, so that its memory is only
+	// allocated once
+	Chart chart;
+	// With --both, a copy of the fixed chart that shares its note tracks
+	// until they are changed
+	Chart feedbackChart;
+	// Number of output files by `WriteResult`
+	unsigned int results[3] = {0, 0, 0};
+	chart.noteFlagMarkers = {
+		NoteFlagMarker(parser.get<std::string>("tap-event"), NOTE_FLAG_VAL_TAP),
+		NoteFlagMarker(parser.get<std::string>("hopo-event"), NOTE_FLAG_VAL_HOPO_FLIP),
+		NoteFlagMarker(parser.get<std::string>("open-event"), NOTE_FLAG_VAL_OPEN, true)
+	};
+	chart.min_sustain_gap = parser.get<unsigned int>("sustain-gap");
+	chart.selectedTracks = tracks;
+	chart.threads = parser.get<unsigned int>("threads");
+	chart.log.minSeverity = log_level;
+	chart.useCache = parser.exist("cache");
+	bool patchMode = parser.exist("patch");
+	chart.edits.enabled = patchMode;
+	// Write the chart or its patch
+	auto output = [&](Chart& c, const std::string& fpath) {
+		if (!patchMode)
+			return c.write(fpath);
+		return c.writePatch(fpath == "-" ? fpath : fpath + ".patch");
+	};
+
+	// Patches made earlier are applied without parsing or fixing anything
+	std::string patch_file = parser.get<std::string>("apply-patch");
+	MappedFile patch;
+	if (patch_file != "" && !patch.open(patch_file)) {
+		std::cerr << "Could not open patch: " << patch_file << "\r\n";
+		return 1;
+	}
+
+	for (std::string input_file : input_files) {
+		chart.clear();
+
+		if (patch_file != "") {
+			chart.log.file = input_file;
+			std::string output_file = parser.exist("stdio") ? "-"
+					: parser.get<std::string>("output-prefix") + outputName(input_file);
+			results[applyPatch(input_file, patch, output_file, chart.log)]++;
+			chart.log.flush(std::cerr, log_format);
+			continue;
 		}
-		if (parser.exist("fix-sustain")) {
-			for (auto it : chart.noteTrackNotes) {
-				std::string section = it.first;
-				fix::fixSustainGap(chart.noteTrackNotes[section], chart.min_sustain_gap);
+
+		if (parser.exist("stdio") && parser.exist("stream")) {
+			// Parse, fix and output one section at a time
+			chart.log.file = input_file;
+			std::ifstream file;
+			if (input_file != "-") {
+				file.open(input_file, std::ios::binary);
+				if (!file) {
+					DIAG(chart.log, diag::SEVERITY_ERROR, "open", TrackId(), diag::NO_TICK,
+							"Could not open file: " << input_file);
+					chart.log.flush(std::cerr, log_format);
+					results[WRITE_FAILED]++;
+					continue;
+				}
 			}
-			fixall = false;
+			stream::tidy(input_file == "-" ? std::cin : file, std::cout, chart, fixes, std::cerr, log_format);
+			continue;
+		}
+
+		// Parse, and leave out a chart that could not be read rather than
+		// write what little of it was
+		if (!chart.read(input_file)) {
+			chart.log.flush(std::cerr, log_format);
+			results[WRITE_FAILED]++;
+			continue;
 		}
-		if (fixall)
-			fix::fixAll(chart);
-		if (parser.exist("feedback-safe"))
-			fix::unsetNoteFlags(chart);
-		else
+
+		// Apply fixes
+		if (both) {
+			fix::applyBase(chart, fixes);
+			chart.log.flush(std::cerr, log_format);
+			feedbackChart = chart;
 			fix::setNoteFlags(chart);
+			fix::unsetNoteFlags(feedbackChart);
+			feedbackChart.log.flush(std::cerr, log_format);
+		} else {
+			fix::apply(chart, fixes);
+		}
+		chart.log.flush(std::cerr, log_format);
 
 		// Output
 		if (parser.exist("stdio")) {
-			chart.write("-");
+			results[output(chart, "-")]++;
 		} else {
 			// Prepend "fixed_" to input file name to get output file name
-			#ifdef _WIN32
-			const char sep = '\\';
-			#else
-			const char sep = '/';
-			#endif
-			std::string output_file = input_file;
-			size_t idx = input_file.rfind(sep, input_file.length());
-			if (idx != std::string::npos)
-				output_file = input_file.substr(idx + 1, input_file.length() - idx);
+			std::string output_file = outputName(input_file);
 
 			// Write to disk
-			chart.write(parser.get<std::string>("output-prefix") + output_file);
+			results[output(chart, parser.get<std::string>("output-prefix") + output_file)]++;
+			if (both) {
+				results[output(feedbackChart, parser.get<std::string>("feedback-prefix") + output_file)]++;
+				feedbackChart.log.flush(std::cerr, log_format);
+			}
 		}
+		// Report any failure to write the output
+		chart.log.flush(std::cerr, log_format);
+	}
+
+	if (!parser.exist("stdio")) {
+		diag::Log summary;
+		summary.minSeverity = log_level;
+		DIAG(summary, diag::SEVERITY_INFO, "summary", TrackId(), diag::NO_TICK,
+				results[WRITE_WRITTEN] << " written, " << results[WRITE_UNCHANGED] << " unchanged, "
+				<< results[WRITE_FAILED] << " failed");
+		summary.flush(std::cerr, log_format);
 	}
-	return 0;
+	return results[WRITE_FAILED] > 0 ? 1 : 0;
 }
@@ -0,0 +1,91 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.h"
+
+MappedFile::MappedFile() :
+mapped(nullptr), length(0) {
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& fpath) {
+	close();
+#ifndef _WIN32
+	int fd = ::open(fpath.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr != MAP_FAILED) {
+			madvise(addr, st.st_size, MADV_SEQUENTIAL);
+			mapped = static_cast<const char*>(addr);
+			length = st.st_size;
+			::close(fd);
+			return true;
+		}
+	}
+	::close(fd);
+#endif
+	// Empty files, pipes and platforms without mmap fall back to reading
+	std::ifstream in(fpath, std::ios::binary);
+	if (!in)
+		return false;
+	return open(in);
+}
+
+bool MappedFile::open(std::istream& in) {
+	close();
+	buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return !in.bad();
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+	if (mapped != nullptr)
+		munmap(const_cast<char*>(mapped), length);
+#endif
+	mapped = nullptr;
+	length = 0;
+	buffer.clear();
+}
+
+const char* MappedFile::data() const {
+	return mapped != nullptr ? mapped : buffer.data();
+}
+
+size_t MappedFile::size() const {
+	return mapped != nullptr ? length : buffer.size();
+}
@@ -0,0 +1,126 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+
+#include "notecolumn.h"
+
+const size_t NoteColumn::npos;
+
+void NoteColumn::clear() {
+	times.clear();
+	values.clear();
+	durations.clear();
+}
+
+void NoteColumn::reserve(size_t count) {
+	times.reserve(count);
+	values.reserve(count);
+	durations.reserve(count);
+}
+
+Note NoteColumn::note(size_t i) const {
+	Note note;
+	note.time = times[i];
+	note.value = values[i];
+	note.duration = durations[i];
+	return note;
+}
+
+size_t NoteColumn::lowerBound(uint32_t tick) const {
+	return std::lower_bound(times.begin(), times.end(), tick) - times.begin();
+}
+
+size_t NoteColumn::find(uint32_t tick) const {
+	size_t i = lowerBound(tick);
+	return (i != times.size() && times[i] == tick) ? i : npos;
+}
+
+std::pair<size_t, size_t> NoteColumn::range(uint32_t begin, uint32_t end) const {
+	size_t first = lowerBound(begin);
+	size_t last = (end <= begin) ? first : std::lower_bound(times.begin() + first, times.end(), end) - times.begin();
+	return std::make_pair(first, last);
+}
+
+void NoteColumn::push_back(uint32_t time, uint32_t value, uint32_t duration) {
+	times.push_back(time);
+	values.push_back(value);
+	durations.push_back(duration);
+}
+
+void NoteColumn::insert(std::vector<Note> batch) {
+	std::stable_sort(batch.begin(), batch.end(), [](const Note& a, const Note& b) {
+		return a.time < b.time;
+	});
+	NoteColumn sorted;
+	sorted.reserve(batch.size());
+	for (const Note& note : batch) {
+		if (!sorted.empty() && sorted.times.back() == note.time)
+			sorted.values.back() |= note.value;
+		else
+			sorted.push_back(note.time, note.value, note.duration);
+	}
+	merge(sorted);
+}
+
+void NoteColumn::merge(const NoteColumn& other) {
+	if (other.empty())
+		return;
+	if (empty() || times.back() < other.times.front()) {
+		// Nothing to interleave
+		times.insert(times.end(), other.times.begin(), other.times.end());
+		values.insert(values.end(), other.values.begin(), other.values.end());
+		durations.insert(durations.end(), other.durations.begin(), other.durations.end());
+		return;
+	}
+	NoteColumn merged;
+	merged.reserve(size() + other.size());
+	size_t a = 0;
+	size_t b = 0;
+	while (a < size() || b < other.size()) {
+		if (b == other.size() || (a < size() && times[a] < other.times[b])) {
+			merged.push_back(times[a], values[a], durations[a]);
+			a++;
+		} else if (a == size() || other.times[b] < times[a]) {
+			merged.push_back(other.times[b], other.values[b], other.durations[b]);
+			b++;
+		} else {
+			merged.push_back(times[a], values[a] | other.values[b], durations[a]);
+			a++;
+			b++;
+		}
+	}
+	swap(merged);
+}
+
+void NoteColumn::erase(size_t first, size_t last) {
+	times.erase(times.begin() + first, times.begin() + last);
+	values.erase(values.begin() + first, values.begin() + last);
+	durations.erase(durations.begin() + first, durations.begin() + last);
+}
+
+void NoteColumn::shift(uint32_t delta) {
+	for (uint32_t& time : times)
+		time += delta;
+}
+
+void NoteColumn::swap(NoteColumn& other) {
+	times.swap(other.times);
+	values.swap(other.values);
+	durations.swap(other.durations);
+}
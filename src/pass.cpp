@@ -0,0 +1,165 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+
+#include "fix.h"
+#include "parallel.h"
+#include "pass.h"
+
+fix::TrackSweep::TrackSweep(Chart& chart, TrackId id) :
+TrackSweep(chart, id, chart.log, chart.edits) {
+}
+
+fix::TrackSweep::TrackSweep(Chart& chart, TrackId id, diag::Log& log, patch::EditList& edits) :
+chart(chart), id(id), section(id.name()), log(log), edits(edits),
+current(&chart.noteTracks.get(id.index())), modifiable(nullptr) {
+}
+
+NoteTrack& fix::TrackSweep::modify() {
+	if (modifiable == nullptr) {
+		modifiable = &chart.noteTracks[id.index()];
+		current = modifiable;
+	}
+	modifiable->settle(chart.timeline);
+	return *modifiable;
+}
+
+void fix::sweepTracks(Chart& chart, const std::function<void(TrackSweep&)>& fn) {
+	chart.loadAll();
+	std::vector<unsigned int> present;
+	for (unsigned int i = 0; i < TrackId::COUNT; i++) {
+		if (chart.noteTracks.get(i).present)
+			present.push_back(i);
+	}
+	if (chart.threads <= 1 || present.size() <= 1) {
+		for (unsigned int i : present) {
+			TrackSweep sweep(chart, TrackId(i));
+			fn(sweep);
+		}
+		return;
+	}
+
+	// Largest tracks first, so that the chart takes about as long as its
+	// largest track rather than waiting on one that was started last
+	std::vector<size_t> work(present.size());
+	for (size_t p = 0; p < work.size(); p++)
+		work[p] = p;
+	std::stable_sort(work.begin(), work.end(), [&](size_t a, size_t b) {
+		const NoteTrack& ta = chart.noteTracks.get(present[a]);
+		const NoteTrack& tb = chart.noteTracks.get(present[b]);
+		return ta.notes.size() + ta.events.size() > tb.notes.size() + tb.events.size();
+	});
+	std::vector<diag::Log> logs(present.size());
+	std::vector<patch::EditList> edits(present.size());
+	parallelFor(work.size(), chart.threads, [&](size_t w) {
+		size_t p = work[w];
+		logs[p].minSeverity = chart.log.minSeverity;
+		edits[p].enabled = chart.edits.enabled;
+		TrackSweep sweep(chart, TrackId(present[p]), logs[p], edits[p]);
+		fn(sweep);
+	});
+	for (size_t p = 0; p < present.size(); p++) {
+		chart.log.append(logs[p]);
+		chart.edits.append(edits[p]);
+	}
+}
+
+fix::Pass::Pass(const char* name, Phase phase, unsigned int reads, unsigned int writes) :
+name(name), phase(phase), reads(reads), writes(writes) {
+}
+
+bool fix::Pass::fusesWith(const Pass& earlier) const {
+	unsigned int shared = (earlier.writes & (reads | writes)) | (earlier.reads & writes);
+	if (shared == 0)
+		return true;
+	// Visitors interleave note by note, so neither would see the other's
+	// work on the whole track
+	if (phase == PHASE_NOTES && earlier.phase == PHASE_NOTES)
+		return false;
+	// A later phase sees everything done in an earlier one
+	return phase >= earlier.phase;
+}
+
+fix::Schedule::Schedule(const Options& options) {
+	for (const PassInfo& info : registry()) {
+		if (info.option != nullptr && !(options.*info.option))
+			continue;
+		std::unique_ptr<Pass> pass = info.create(options);
+		if (pass)
+			passes.push_back(std::move(pass));
+	}
+}
+
+void fix::Schedule::begin(Chart& chart) {
+	groups.clear();
+	for (const std::unique_ptr<Pass>& pass : passes) {
+		if (!pass->begin(chart))
+			continue;
+		// Join the last sweep if every pass in it is compatible
+		bool fuses = !groups.empty();
+		for (size_t i = 0; fuses && i < groups.back().size(); i++)
+			fuses = pass->fusesWith(*groups.back()[i]);
+		if (!fuses)
+			groups.push_back(std::vector<Pass*>());
+		groups.back().push_back(pass.get());
+	}
+	for (size_t g = 0; g < groups.size(); g++) {
+		std::string names;
+		for (const Pass* pass : groups[g])
+			names += std::string(names.empty() ? "" : ", ") + pass->name;
+		DIAG(chart.log, diag::SEVERITY_DEBUG, "passes", TrackId(), diag::NO_TICK,
+				"Sweep " << (g + 1) << " of " << groups.size() << ": " << names);
+	}
+}
+
+void fix::Schedule::sweep(Chart& chart, TrackId id) {
+	TrackSweep trackSweep(chart, id);
+	sweep(trackSweep);
+}
+
+void fix::Schedule::sweep(TrackSweep& sweep) {
+	for (const std::vector<Pass*>& group : groups) {
+		std::vector<Pass*> visitors;
+		for (Pass* pass : group) {
+			pass->beginTrack(sweep);
+			if (pass->phase == PHASE_NOTES)
+				visitors.push_back(pass);
+		}
+		if (!visitors.empty()) {
+			for (size_t n = 0; n < sweep.track().notes.size(); n++) {
+				for (Pass* pass : visitors)
+					pass->visit(sweep, n);
+			}
+		}
+		for (Pass* pass : group)
+			pass->endTrack(sweep);
+	}
+}
+
+void fix::Schedule::end(Chart& chart) {
+	for (const std::unique_ptr<Pass>& pass : passes)
+		pass->end(chart);
+}
+
+void fix::Schedule::run(Chart& chart) {
+	begin(chart);
+	if (!groups.empty())
+		sweepTracks(chart, [this](TrackSweep& trackSweep) { sweep(trackSweep); });
+	end(chart);
+}
@@ -0,0 +1,457 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include "hash.h"
+#include "patch.h"
+
+#define PATCH_MAGIC "chart-tidy patch 1"
+
+patch::EditList::EditList() :
+enabled(false), sourceSize(0), sourceHash(0) {
+}
+
+void patch::EditList::clear() {
+	sourceSize = 0;
+	sourceHash = 0;
+	edits.clear();
+}
+
+void patch::EditList::insert(const std::string& section, const Event& evt, const StringPool& strings) {
+	if (!enabled)
+		return;
+	Edit edit = {OP_INSERT, section, evt.time, evt.toEventString(strings), "", 0};
+	edits.push_back(edit);
+}
+
+void patch::EditList::erase(const std::string& section, const Event& evt, const StringPool& strings) {
+	if (!enabled)
+		return;
+	Edit edit = {OP_DELETE, section, evt.time, evt.toEventString(strings), "", 0};
+	edits.push_back(edit);
+}
+
+void patch::EditList::modify(const std::string& section, const Event& before, const Event& after,
+		const StringPool& strings) {
+	if (!enabled)
+		return;
+	Edit edit = {OP_MODIFY, section, before.time, before.toEventString(strings), after.toEventString(strings), 0};
+	edits.push_back(edit);
+}
+
+void patch::EditList::modifyDuration(const std::string& section, uint32_t tick, uint32_t duration) {
+	if (!enabled)
+		return;
+	Edit edit = {OP_DURATION, section, tick, "", "", duration};
+	edits.push_back(edit);
+}
+
+void patch::EditList::shift(const std::string& section, uint32_t from, uint32_t delta) {
+	if (!enabled)
+		return;
+	Edit edit = {OP_SHIFT, section, from, "", "", delta};
+	edits.push_back(edit);
+}
+
+void patch::EditList::set(const std::string& section, const std::string& key, const std::string& value) {
+	if (!enabled)
+		return;
+	Edit edit = {OP_SET, section, 0, key, value, 0};
+	edits.push_back(edit);
+}
+
+void patch::EditList::append(EditList& other) {
+	edits.insert(edits.end(), std::make_move_iterator(other.edits.begin()),
+			std::make_move_iterator(other.edits.end()));
+	other.edits.clear();
+}
+
+void patch::EditList::write(Writer& out) const {
+	char hash[17];
+	snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(sourceHash));
+	out.put(PATCH_MAGIC "\r\n");
+	out.put("source ").putUnsigned(sourceSize).put(' ').put(hash, 16).put("\r\n");
+	const std::string* section = nullptr;
+	for (const Edit& edit : edits) {
+		if (section == nullptr || *section != edit.section) {
+			section = &edit.section;
+			out.put('[').put(edit.section).put("]\r\n");
+		}
+		out.put(static_cast<char>(edit.op)).put(' ');
+		switch (edit.op) {
+		case OP_INSERT:
+		case OP_DELETE:
+			out.put(edit.line);
+			break;
+		case OP_MODIFY:
+			out.put(edit.line).put('\t').put(edit.replacement);
+			break;
+		case OP_DURATION:
+		case OP_SHIFT:
+			out.putUnsigned(edit.tick).put(' ').putUnsigned(edit.delta);
+			break;
+		case OP_SET:
+			out.put(edit.line).put(" = ").put(edit.replacement);
+			break;
+		}
+		out.put("\r\n");
+	}
+}
+
+namespace {
+	/** The edits to one section of the chart */
+	struct SectionEdits {
+		std::string name;
+		std::vector<patch::Edit> edits;
+		bool found;
+	};
+
+	/** The next line of `text` from `pos`, without its line ending */
+	StrView readLine(const char*& pos, const char* end) {
+		const char* eol = static_cast<const char*>(memchr(pos, '\n', end - pos));
+		if (eol == nullptr)
+			eol = end;
+		StrView line(pos, (eol != pos && eol[-1] == '\r') ? eol - 1 : eol);
+		pos = (eol == end) ? eol : eol + 1;
+		return line;
+	}
+
+	/** Split `line` at whitespace into its tokens */
+	void tokens(StrView line, std::vector<StrView>& out) {
+		out.clear();
+		const char* c = line.begin();
+		while (c != line.end()) {
+			while (c != line.end() && StrView::isSpace(*c))
+				++c;
+			const char* start = c;
+			while (c != line.end() && !StrView::isSpace(*c))
+				++c;
+			if (c != start)
+				out.push_back(StrView(start, c));
+		}
+	}
+
+	/** True if the lines hold the same tokens, ignoring spacing */
+	bool sameLine(StrView a, StrView b) {
+		std::vector<StrView> ta, tb;
+		tokens(a, ta);
+		tokens(b, tb);
+		if (ta.size() != tb.size())
+			return false;
+		for (size_t i = 0; i < ta.size(); i++) {
+			if (!(ta[i] == tb[i]))
+				return false;
+		}
+		return true;
+	}
+
+	/** The tick at the start of an event line, and the number of characters holding it */
+	bool lineTick(StrView line, uint32_t& tick, size_t& digits) {
+		digits = 0;
+		while (digits < line.size() && line.begin()[digits] >= '0' && line.begin()[digits] <= '9')
+			digits++;
+		return digits > 0 && line.substr(0, digits).toUint(tick);
+	}
+
+	size_t findLine(const std::vector<std::string>& lines, StrView line) {
+		for (size_t i = 0; i < lines.size(); i++) {
+			if (sameLine(lines[i], line))
+				return i;
+		}
+		return lines.size();
+	}
+
+	bool applyEdit(std::vector<std::string>& lines, const patch::Edit& edit, diag::Log& log) {
+		uint32_t tick;
+		size_t digits;
+		size_t i;
+		switch (edit.op) {
+		case patch::OP_INSERT:
+			i = lines.size();
+			if (lineTick(edit.line, tick, digits)) {
+				// Before the first line with a later tick, searching from the end
+				// since most insertions append
+				uint32_t lineAt;
+				while (i > 0 && (!lineTick(lines[i - 1], lineAt, digits) || lineAt > tick))
+					i--;
+			}
+			lines.insert(lines.begin() + i, edit.line);
+			return true;
+		case patch::OP_DELETE:
+		case patch::OP_MODIFY:
+			i = findLine(lines, edit.line);
+			if (i == lines.size()) {
+				DIAG(log, diag::SEVERITY_ERROR, "patch", TrackId::fromName(edit.section), diag::NO_TICK,
+						"[" << edit.section << "] has no line \"" << edit.line << "\"");
+				return false;
+			}
+			if (edit.op == patch::OP_DELETE)
+				lines.erase(lines.begin() + i);
+			else
+				lines[i] = edit.replacement;
+			return true;
+		case patch::OP_DURATION: {
+			// Only lanes carry a duration, flags are always written with 0
+			std::vector<StrView> fields;
+			uint32_t val;
+			bool found = false;
+			for (std::string& line : lines) {
+				if (!lineTick(line, tick, digits) || tick != edit.tick)
+					continue;
+				tokens(line, fields);
+				if (fields.size() != 5 || !(fields[2] == "N") || !fields[3].toUint(val)
+						|| (val > NOTE_FLAG_VAL_ORANGE && val != NOTE_FLAG_VAL_OPEN))
+					continue;
+				line = std::to_string(tick) + " = N " + std::to_string(val) + " " + std::to_string(edit.delta);
+				found = true;
+			}
+			if (!found) {
+				DIAG(log, diag::SEVERITY_ERROR, "patch", TrackId::fromName(edit.section), edit.tick,
+						"[" << edit.section << "] has no note at " << edit.tick);
+			}
+			return found;
+		}
+		case patch::OP_SHIFT:
+			for (std::string& line : lines) {
+				if (lineTick(line, tick, digits) && tick >= edit.tick)
+					line.replace(0, digits, std::to_string(tick + edit.delta));
+			}
+			return true;
+		case patch::OP_SET:
+			for (std::string& line : lines) {
+				StrView key, value;
+				StrView(line).splitOnce(key, value, '=');
+				if (key == edit.line) {
+					line = edit.line + " = " + edit.replacement;
+					return true;
+				}
+			}
+			lines.push_back(edit.line + " = " + edit.replacement);
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Position of a section in a chart as it is written: [Song], [SyncTrack],
+	 * [Events], then the note tracks in `TrackId` order. Other sections last.
+	 */
+	unsigned int sectionRank(StrView name) {
+		if (name == "Song")
+			return 0;
+		if (name == "SyncTrack")
+			return 1;
+		if (name == "Events")
+			return 2;
+		TrackId id = TrackId::fromName(name);
+		return 3 + (id.valid() ? id.index() : TrackId::COUNT);
+	}
+
+	/** Write a section that the chart does not have, made from the edits alone */
+	bool writeNewSection(Writer& out, SectionEdits& section, const char* eol, diag::Log& log) {
+		std::vector<std::string> lines;
+		bool success = true;
+		for (const patch::Edit& edit : section.edits)
+			success = applyEdit(lines, edit, log) && success;
+		out.put('[').put(section.name).put(']').put(StrView(eol)).put('{').put(StrView(eol));
+		for (const std::string& l : lines)
+			out.put('\t').put(l).put(StrView(eol));
+		out.put('}').put(StrView(eol));
+		section.found = true;
+		return success;
+	}
+
+	bool parsePatch(StrView text, uint64_t& size, uint64_t& hash, std::vector<SectionEdits>& sections,
+			diag::Log& log) {
+		const char* pos = text.begin();
+		if (!(readLine(pos, text.end()).trim() == PATCH_MAGIC)) {
+			DIAG(log, diag::SEVERITY_ERROR, "patch", TrackId(), diag::NO_TICK, "Not a chart-tidy patch");
+			return false;
+		}
+		std::vector<StrView> fields;
+		tokens(readLine(pos, text.end()), fields);
+		unsigned long long sourceSize, sourceHash;
+		if (fields.size() != 3 || !(fields[0] == "source")
+				|| sscanf(fields[1].str().c_str(), "%llu", &sourceSize) != 1
+				|| sscanf(fields[2].str().c_str(), "%llx", &sourceHash) != 1) {
+			DIAG(log, diag::SEVERITY_ERROR, "patch", TrackId(), diag::NO_TICK, "Patch has no source line");
+			return false;
+		}
+		size = sourceSize;
+		hash = sourceHash;
+
+		SectionEdits* section = nullptr;
+		while (pos != text.end()) {
+			StrView line = readLine(pos, text.end());
+			if (line.trim().empty())
+				continue;
+			if (line.front() == '[' && line.trim().back() == ']') {
+				std::string name = line.trim().substr(1, line.trim().size() - 2).str();
+				section = nullptr;
+				for (SectionEdits& s : sections) {
+					if (s.name == name)
+						section = &s;
+				}
+				if (section == nullptr) {
+					SectionEdits s = {name, std::vector<patch::Edit>(), false};
+					sections.push_back(s);
+					section = &sections.back();
+				}
+				continue;
+			}
+			if (section == nullptr || line.size() < 2 || line.begin()[1] != ' ') {
+				DIAG(log, diag::SEVERITY_ERROR, "patch", TrackId(), diag::NO_TICK, "Bad patch line: " << line);
+				return false;
+			}
+			patch::Edit edit = {static_cast<patch::Op>(line.front()), section->name, 0, "", "", 0};
+			StrView body(line.begin() + 2, line.end());
+			bool ok = true;
+			switch (edit.op) {
+			case patch::OP_INSERT:
+			case patch::OP_DELETE:
+				edit.line = body.trim().str();
+				break;
+			case patch::OP_MODIFY: {
+				StrView before, after;
+				body.splitOnce(before, after, '\t');
+				edit.line = before.str();
+				edit.replacement = after.str();
+				ok = !after.empty();
+				break;
+			}
+			case patch::OP_DURATION:
+			case patch::OP_SHIFT:
+				tokens(body, fields);
+				ok = fields.size() == 2 && fields[0].toUint(edit.tick) && fields[1].toUint(edit.delta);
+				break;
+			case patch::OP_SET: {
+				StrView key, value;
+				body.splitOnce(key, value, '=');
+				edit.line = key.str();
+				edit.replacement = value.str();
+				break;
+			}
+			default:
+				ok = false;
+			}
+			if (!ok) {
+				DIAG(log, diag::SEVERITY_ERROR, "patch", TrackId(), diag::NO_TICK, "Bad patch line: " << line);
+				return false;
+			}
+			section->edits.push_back(edit);
+		}
+		return true;
+	}
+}
+
+bool patch::apply(StrView original, StrView patchText, Writer& out, diag::Log& log) {
+	uint64_t size, hash;
+	std::vector<SectionEdits> sections;
+	if (!parsePatch(patchText, size, hash, sections, log))
+		return false;
+	if (size != original.size() || hash != fnv1a(original.begin(), original.size())) {
+		DIAG(log, diag::SEVERITY_ERROR, "patch", TrackId(), diag::NO_TICK,
+				"The patch was made from a different file");
+		return false;
+	}
+	const char* eol = memchr(original.begin(), '\r', original.size()) != nullptr ? "\r\n" : "\n";
+
+	// Sections that the fixes added are written in their place among the
+	// sections of the chart
+	std::vector<SectionEdits*> created;
+	for (SectionEdits& s : sections)
+		created.push_back(&s);
+	for (const char* pos = original.begin(); pos != original.end();) {
+		StrView line = readLine(pos, original.end()).trim();
+		if (!line.empty() && line.front() == '[' && line.back() == ']') {
+			StrView name = line.substr(1, line.size() - 2);
+			created.erase(std::remove_if(created.begin(), created.end(),
+					[&](const SectionEdits* s) { return name == s->name; }), created.end());
+		}
+	}
+	std::stable_sort(created.begin(), created.end(), [](const SectionEdits* a, const SectionEdits* b) {
+		return sectionRank(a->name) < sectionRank(b->name);
+	});
+	size_t nextCreated = 0;
+
+	// Copy the chart through, rewriting only the bodies of the patched sections
+	bool success = true;
+	const char* copied = original.begin();
+	const char* pos = original.begin();
+	SectionEdits* section = nullptr;
+	std::vector<std::string> lines;
+	while (pos != original.end()) {
+		const char* lineStart = pos;
+		StrView line = readLine(pos, original.end()).trim();
+		if (line.empty())
+			continue;
+		if (line.front() == '[' && line.back() == ']') {
+			unsigned int rank = sectionRank(line.substr(1, line.size() - 2));
+			if (nextCreated < created.size() && sectionRank(created[nextCreated]->name) < rank) {
+				out.put(copied, lineStart - copied);
+				copied = lineStart;
+				while (nextCreated < created.size() && sectionRank(created[nextCreated]->name) < rank)
+					success = writeNewSection(out, *created[nextCreated++], eol, log) && success;
+			}
+			section = nullptr;
+			for (SectionEdits& s : sections) {
+				if (line.substr(1, line.size() - 2) == s.name && !s.found)
+					section = &s;
+			}
+		} else if (line == "{" && section != nullptr) {
+			// Collect the body up to the closing brace
+			out.put(copied, pos - copied);
+			lines.clear();
+			const char* bodyEnd = pos;
+			while (pos != original.end()) {
+				bodyEnd = pos;
+				StrView bodyLine = readLine(pos, original.end()).trim();
+				if (bodyLine == "}")
+					break;
+				if (!bodyLine.empty())
+					lines.push_back(bodyLine.str());
+				bodyEnd = pos;
+			}
+			for (const Edit& edit : section->edits)
+				success = applyEdit(lines, edit, log) && success;
+			for (const std::string& l : lines)
+				out.put('\t').put(l).put(StrView(eol));
+			copied = bodyEnd;
+			section->found = true;
+			section = nullptr;
+		}
+	}
+	out.put(copied, original.end() - copied);
+	if (nextCreated < created.size() && !original.empty() && original.back() != '\n')
+		out.put(StrView(eol));
+	while (nextCreated < created.size())
+		success = writeNewSection(out, *created[nextCreated++], eol, log) && success;
+
+	for (const SectionEdits& s : sections) {
+		if (!s.found) {
+			DIAG(log, diag::SEVERITY_ERROR, "patch", TrackId::fromName(s.name), diag::NO_TICK,
+					"The chart has no [" << s.name << "] section");
+			success = false;
+		}
+	}
+	return success;
+}
@@ -17,34 +17,49 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <iostream>
+#include <vector>
 
 #include "render.h"
+#include "timing.h"
 
 void draw(std::string(&lines)[5], char c);
 void draw(std::string(&lines)[5], char (&c)[5]);
 
 void renderer::chartToText(const Chart& chart) {
 	const unsigned int measures_per_line = 1;
-	const unsigned int unit_time = 48;
+	const unsigned int units_per_measure = 16; // One character per 16th note
 
 	std::cout << "Name:   \t" << chart.name << "\r\n";
 	std::cout << "Artist: \t" << chart.artist << "\r\n";
 	std::cout << "Charter:\t" << chart.charter << "\r\n";
 	std::cout << "\r\n";
 
-	for (auto const& e0 : chart.noteTrackNotes) {
-		std::string section = e0.first;
-		std::map<uint32_t, Note> notes = chart.noteTrackNotes.at(section);
-		std::cout << section << "\r\n" << "\r\n";
+	for (unsigned int i = 0; i < TrackId::COUNT; i++) {
+		if (!chart.noteTracks[i].present)
+			continue;
+		const NoteTrack& track = chart.noteTracks[i];
+		const NoteColumn& notes = track.notes;
+		std::cout << TrackId(i).name() << "\r\n" << "\r\n";
 
 		unsigned int ctime = 0; // Current time
 		std::string lines[5] = {"G", "R", "Y", "B", "O"};
+		// Map ticks still waiting for the chart's timeline
+		const uint32_t* ticks = notes.timeData();
+		std::vector<uint32_t> mapped;
+		if (track.retimed < chart.timeline.size()) {
+			mapped.resize(notes.size());
+			for (size_t n = 0; n < notes.size(); n++)
+				mapped[n] = chart.timeline.map(notes.time(n), track.retimed);
+			ticks = mapped.data();
+		}
+		// Normalise time
+		std::vector<uint32_t> units(notes.size());
+		timing::toUnits<units_per_measure>(chart.resolution, ticks, notes.size(), units.data());
 		draw(lines, '|');
-		for (auto const& e1 : notes) {
-			uint32_t time = e1.first;
-			Note note = notes[time];
+		for (size_t n = 0; n < notes.size(); n++) {
+			uint32_t time = units[n];
+			Note note = notes.note(n);
 
-			time /= unit_time; // Normalise time
 			// Fill empty space
 			while (time > ctime) {
 				ctime += 1;
@@ -0,0 +1,168 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string>
+
+#include "stream.h"
+
+namespace {
+	/**
+	 * Progress through a chart that is being streamed.
+	 */
+	class Streamer {
+	public:
+		Streamer(std::ostream& out, Chart& chart, const fix::Options& options, std::ostream& err,
+				diag::Format format) :
+		out(out), chart(chart), options(options), schedule(options), err(err), format(format),
+		metadataWritten(false), holdEvents(false) {
+		}
+
+		bool section(const std::string& section, StrView body);
+		void finish();
+		/** Write out the diagnostics raised so far */
+		void flushLog() { chart.log.flush(err, format); }
+	private:
+		void writeMetadata();
+
+		Writer out;
+		Chart& chart;
+		const fix::Options& options;
+		/** The fixes, swept over each note track as it is read */
+		fix::Schedule schedule;
+		std::ostream& err;
+		diag::Format format;
+		bool metadataWritten;
+		/** [Events] is waiting for the end event to be inserted */
+		bool holdEvents;
+	};
+}
+
+bool Streamer::section(const std::string& section, StrView body) {
+	if (section == SONG_SECTION || section == SYNC_TRACK_SECTION || section == EVENTS_SECTION) {
+		if (metadataWritten) {
+			DIAG(chart.log, diag::SEVERITY_ERROR, "stream", TrackId(), diag::NO_TICK,
+					"Cannot stream [" << section << "] after the note tracks");
+			return false;
+		}
+		return chart.parseSection(section, body);
+	}
+	TrackId id = TrackId::fromName(section);
+
+	// The metadata is final once the note tracks begin
+	if (!metadataWritten)
+		writeMetadata();
+
+	bool success = true;
+	if (chart.isSelected(id))
+		success = chart.parseSection(section, body);
+	else
+		chart.keepSection(section, body);
+	if (!id.valid() || !chart.isSelected(id)) {
+		// Not a note section, or not a selected one, so it is kept as it is
+		chart.writeRawSections(out);
+		out.flush();
+		chart.rawSections.clear();
+		return success;
+	}
+
+	// Chart-wide fixes have already been applied to the metadata, so the
+	// per-track part of them is applied here
+	schedule.sweep(chart, id);
+
+	chart.writeNoteSection(out, id);
+	out.flush();
+	chart.noteTracks[id.index()].clear();
+	return success;
+}
+
+void Streamer::writeMetadata() {
+	holdEvents = options.endEvent && !fix::hasEndEvent(chart);
+	schedule.begin(chart);
+
+	chart.writeSongSection(out);
+	chart.writeSyncTrackSection(out);
+	if (!holdEvents)
+		chart.writeEventsSection(out);
+	out.flush();
+	metadataWritten = true;
+}
+
+void Streamer::finish() {
+	if (!metadataWritten)
+		writeMetadata();
+	// Places the end event once every note track has been seen
+	schedule.end(chart);
+	if (holdEvents)
+		chart.writeEventsSection(out);
+	out.flush();
+	flushLog();
+}
+
+bool stream::tidy(std::istream& in, std::ostream& out, Chart& chart, const fix::Options& options,
+		std::ostream& err, diag::Format format) {
+	Streamer streamer(out, chart, options, err, format);
+	bool errors = false;
+	bool inBlock = false;
+	std::string section;
+	std::string body; // Lines of the current section, reused between sections
+
+	for (std::string line; getline(in, line);) {
+		StrView trimmed = StrView(line).trim();
+		if (inBlock) {
+			if (trimmed == "}") {
+				// End of section block
+				if (!streamer.section(section, StrView(body)))
+					errors = true;
+				streamer.flushLog();
+				inBlock = false;
+				section = "";
+				body.clear();
+			} else {
+				body.append(line);
+				body.push_back('\n');
+			}
+			continue;
+		}
+
+		if (trimmed.empty())
+			continue; // Skip blank lines
+
+		if (section == "" && trimmed.front() == '[') {
+			// Begin section header
+			if (trimmed.back() == ']') {
+				section = trimmed.substr(1, trimmed.size() - 2).str();
+			} else {
+				DIAG(chart.log, diag::SEVERITY_ERROR, "syntax", TrackId(), diag::NO_TICK,
+						"Unhandled syntax: " << trimmed);
+				errors = true;
+			}
+		} else if (trimmed == "{") {
+			// Start of section block
+			inBlock = true;
+		} else {
+			DIAG(chart.log, diag::SEVERITY_ERROR, "syntax", TrackId(), diag::NO_TICK,
+					"Illegal state for line: " << trimmed);
+			errors = true;
+		}
+	}
+	// A block left open at the end of the file runs to the end of the file
+	if (inBlock && !streamer.section(section, StrView(body)))
+		errors = true;
+	streamer.finish();
+	return !errors;
+}
@@ -0,0 +1,104 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "stringpool.h"
+
+StringPool::StringPool() {
+	intern(StrView(""));
+}
+
+StringPool::StringPool(const StringPool& other) {
+	views.reserve(other.views.size());
+	for (StrView str : other.views)
+		intern(str);
+}
+
+StringPool& StringPool::operator=(const StringPool& other) {
+	if (this != &other) {
+		clear();
+		for (size_t id = 1; id < other.views.size(); id++)
+			intern(other.views[id]);
+	}
+	return *this;
+}
+
+uint32_t StringPool::intern(StrView str) {
+	if ((views.size() + 1) * 2 > table.size())
+		grow();
+	size_t s = slot(str);
+	if (table[s] != 0)
+		return table[s] - 1;
+
+	char* data = static_cast<char*>(arena.allocate(str.size(), 1));
+	if (!str.empty())
+		memcpy(data, str.begin(), str.size());
+	uint32_t id = views.size();
+	views.push_back(StrView(data, data + str.size()));
+	table[s] = id + 1;
+	return id;
+}
+
+bool StringPool::find(StrView str, uint32_t& id) const {
+	if (table.empty())
+		return false;
+	size_t s = slot(str);
+	if (table[s] == 0)
+		return false;
+	id = table[s] - 1;
+	return true;
+}
+
+void StringPool::clear() {
+	views.clear();
+	std::fill(table.begin(), table.end(), 0);
+	arena.reset();
+	intern(StrView(""));
+}
+
+void StringPool::swap(StringPool& other) {
+	arena.swap(other.arena);
+	views.swap(other.views);
+	table.swap(other.table);
+}
+
+size_t StringPool::hash(StrView str) {
+	// FNV-1a
+	size_t hash = 2166136261u;
+	for (char c : str) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+size_t StringPool::slot(StrView str) const {
+	size_t mask = table.size() - 1;
+	size_t s = hash(str) & mask;
+	while (table[s] != 0 && views[table[s] - 1] != str)
+		s = (s + 1) & mask; // Linear probing
+	return s;
+}
+
+void StringPool::grow() {
+	table.assign(table.empty() ? 64 : table.size() * 2, 0);
+	for (size_t id = 0; id < views.size(); id++)
+		table[slot(views[id])] = id + 1;
+}
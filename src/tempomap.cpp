@@ -0,0 +1,151 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+
+#include "tempomap.h"
+
+/** Microseconds per minute, times 1000 to cancel the scale of `bpmT` */
+static const uint64_t MICROS_PER_MINUTE_T = 60000000000ULL;
+
+TempoMap::TempoMap() :
+ticksPerBeat(DEFAULT_RESOLUTION) {
+	EventList none;
+	build(none, DEFAULT_RESOLUTION);
+}
+
+TempoMap::TempoMap(const EventList& syncTrack, int resolution) :
+ticksPerBeat(DEFAULT_RESOLUTION) {
+	build(syncTrack, resolution);
+}
+
+void TempoMap::build(const EventList& syncTrack, int resolution) {
+	ticksPerBeat = timing::ticksPerBeat(resolution);
+	segments.clear();
+	timeSignatures.clear();
+
+	Segment first;
+	first.tick = 0;
+	first.bpmT = DEFAULT_BPMT;
+	first.micros = 0;
+	segments.push_back(first);
+	timeSignatures.push_back(std::make_pair(0u, 4u));
+
+	for (const SyncTrackEvent& evt : syncTrack) {
+		if (evt.isTsChange() && evt.value > 0) {
+			if (timeSignatures.back().first == evt.time)
+				timeSignatures.back().second = evt.value;
+			else
+				timeSignatures.push_back(std::make_pair(evt.time, evt.value));
+		}
+		if (!evt.isTempoChange() || evt.value == 0)
+			continue;
+		Segment& last = segments.back();
+		if (last.tick == evt.time) {
+			// A later tempo at the same tick replaces the earlier one
+			last.bpmT = evt.value;
+			continue;
+		}
+		Segment seg;
+		seg.tick = evt.time;
+		seg.bpmT = evt.value;
+		seg.micros = toMicros(last, evt.time);
+		segments.push_back(seg);
+	}
+}
+
+uint64_t TempoMap::tickToMicros(uint32_t tick) const {
+	return toMicros(segments[segmentAt(tick)], tick);
+}
+
+uint32_t TempoMap::microsToTick(uint64_t micros) const {
+	auto it = std::upper_bound(segments.begin(), segments.end(), micros, [](uint64_t t, const Segment& seg) {
+		return t < seg.micros;
+	});
+	const Segment& seg = *(it - 1);
+
+	// Estimate in floating point, then correct against the exact forward
+	// conversion, whose intermediate values cannot overflow
+	double ticks = static_cast<double>(micros - seg.micros) * seg.bpmT * ticksPerBeat / MICROS_PER_MINUTE_T;
+	uint64_t tick = seg.tick + static_cast<uint64_t>(ticks);
+	uint64_t end = (it == segments.end()) ? UINT32_MAX : it->tick - 1;
+	if (tick > end)
+		tick = end;
+	while (tick > seg.tick && toMicros(seg, tick) > micros)
+		tick--;
+	while (tick < end && toMicros(seg, tick + 1) <= micros)
+		tick++;
+	return tick;
+}
+
+void TempoMap::ticksToMicros(const uint32_t* ticks, size_t count, uint64_t* out) const {
+	size_t s = 0;
+	for (size_t i = 0; i < count; i++) {
+		uint32_t tick = ticks[i];
+		if (tick < segments[s].tick) {
+			s = segmentAt(tick); // Out of order, search again
+		} else {
+			while (s + 1 < segments.size() && segments[s + 1].tick <= tick)
+				s++;
+		}
+		out[i] = toMicros(segments[s], tick);
+	}
+}
+
+void TempoMap::ticksToMicros(const NoteColumn& notes, const Timeline& timeline, size_t from,
+		std::vector<uint64_t>& out) const {
+	out.resize(notes.size());
+	if (notes.empty())
+		return;
+	if (from >= timeline.size()) {
+		ticksToMicros(notes.timeData(), notes.size(), &out[0]);
+		return;
+	}
+	std::vector<uint32_t> ticks(notes.size());
+	for (size_t i = 0; i < notes.size(); i++)
+		ticks[i] = timeline.map(notes.time(i), from);
+	ticksToMicros(ticks.data(), ticks.size(), &out[0]);
+}
+
+uint32_t TempoMap::bpmTAt(uint32_t tick) const {
+	return segments[segmentAt(tick)].bpmT;
+}
+
+uint32_t TempoMap::beatsPerMeasureAt(uint32_t tick) const {
+	auto it = std::upper_bound(timeSignatures.begin(), timeSignatures.end(), tick,
+			[](uint32_t t, const std::pair<uint32_t, uint32_t>& ts) {
+		return t < ts.first;
+	});
+	return (it - 1)->second;
+}
+
+size_t TempoMap::segmentAt(uint32_t tick) const {
+	auto it = std::upper_bound(segments.begin(), segments.end(), tick, [](uint32_t t, const Segment& seg) {
+		return t < seg.tick;
+	});
+	return (it - segments.begin()) - 1;
+}
+
+uint64_t TempoMap::toMicros(const Segment& seg, uint32_t tick) const {
+	// micros = ticks * 60,000,000 / (BPM * resolution)
+	uint64_t ticks = tick - seg.tick;
+	uint64_t divisor = static_cast<uint64_t>(seg.bpmT) * ticksPerBeat;
+	if (ticks > UINT64_MAX / MICROS_PER_MINUTE_T) // Far beyond any real chart
+		return seg.micros + static_cast<uint64_t>(static_cast<long double>(ticks) * MICROS_PER_MINUTE_T / divisor);
+	return seg.micros + (ticks * MICROS_PER_MINUTE_T) / divisor;
+}
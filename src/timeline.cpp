@@ -0,0 +1,59 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "timeline.h"
+
+void Timeline::insert(uint32_t tick, uint32_t length) {
+	if (length == 0)
+		return;
+	Step step = {1, 1, tick, length};
+	steps.push_back(step);
+}
+
+bool Timeline::scale(uint32_t num, uint32_t den) {
+	if (den == 0 || num < den)
+		return false;
+	if (num != den) {
+		Step step = {num, den, 0, 0};
+		steps.push_back(step);
+	}
+	return true;
+}
+
+uint32_t Timeline::mapSteps(uint32_t tick, size_t from) const {
+	for (size_t s = from; s < steps.size(); s++) {
+		const Step& step = steps[s];
+		if (step.num != step.den)
+			tick = static_cast<uint64_t>(tick) * step.num / step.den;
+		if (tick >= step.tick)
+			tick += step.length;
+	}
+	return tick;
+}
+
+Note Timeline::mapSteps(Note note, size_t from) const {
+	note.duration = mapSteps(note.time + note.duration, from) - mapSteps(note.time, from);
+	note.time = mapSteps(note.time, from);
+	return note;
+}
+
+Event Timeline::mapSteps(Event evt, size_t from) const {
+	evt.duration = mapSteps(evt.time + evt.duration, from) - mapSteps(evt.time, from);
+	evt.time = mapSteps(evt.time, from);
+	return evt;
+}
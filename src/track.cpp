@@ -0,0 +1,44 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "track.h"
+
+const unsigned int TrackId::COUNT;
+
+TrackId TrackId::fromName(StrView name) {
+	// The first letter narrows the difficulty down to at most two candidates
+	// before any string comparison is done
+	for (unsigned int d = 0; d < DIFFICULTY_COUNT; d++) {
+		StrView prefix(DIFFICULTY_NAMES[d]);
+		if (name.empty() || name.front() != prefix.front() || !name.startsWith(prefix))
+			continue;
+		StrView suffix(name.begin() + prefix.size(), name.end());
+		for (unsigned int i = 0; i < INSTRUMENT_COUNT; i++) {
+			if (suffix == INSTRUMENT_NAMES[i])
+				return TrackId(static_cast<Instrument>(i), static_cast<Difficulty>(d));
+		}
+		return TrackId();
+	}
+	return TrackId();
+}
+
+std::string TrackId::name() const {
+	if (!valid())
+		return "";
+	return std::string(DIFFICULTY_NAMES[difficulty()]) + INSTRUMENT_NAMES[instrument()];
+}
@@ -0,0 +1,263 @@
+/**
+ *  chart-tidy - A tool for automatically fixing Guitar Hero III song charts.
+ *
+ *  Copyright (C) 2016  lykat1
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "writer.h"
+
+const size_t Writer::BLOCK_SIZE;
+
+/** Initial buffer size, grown by `reserve` up to BLOCK_SIZE */
+static const size_t MIN_BUFFER_SIZE = 4096;
+
+Writer::Writer() :
+		Writer(MIN_BUFFER_SIZE) {
+#ifndef _WIN32
+	// Anything already written through std::cout has to come first
+	std::cout.flush();
+	fd = STDOUT_FILENO;
+#else
+	stream = &std::cout;
+#endif
+}
+
+Writer::Writer(std::ostream& out) :
+		Writer(MIN_BUFFER_SIZE) {
+	stream = &out;
+}
+
+Writer::Writer(std::string& out) :
+		Writer(256) {
+	str = &out;
+}
+
+Writer::Writer(size_t bufferSize) :
+		buffer(bufferSize), used(0), good(true), mode(0), previousExists(false), matched(0), diverged(false),
+		sameAsPrevious(false), fd(-1), ownsFd(false), stream(nullptr), str(nullptr) {
+}
+
+Writer::~Writer() {
+	if (!path.empty())
+		close();
+	else
+		flush();
+}
+
+bool Writer::open(const std::string& fpath) {
+	if (!path.empty())
+		close();
+	else
+		flush();
+	path = fpath;
+#ifndef _WIN32
+	// Replace the file a link points to rather than the link itself
+	char resolved[PATH_MAX];
+	if (realpath(fpath.c_str(), resolved) != nullptr)
+		path = resolved;
+	// New files get the permissions that open(2) would give them
+	struct stat info;
+	if (stat(path.c_str(), &info) == 0) {
+		mode = info.st_mode & 07777;
+	} else {
+		mode_t mask = umask(0);
+		umask(mask);
+		mode = 0666 & ~mask;
+	}
+	tmpPath.clear();
+#else
+	tmpPath = fpath + ".tmp";
+#endif
+	previousExists = previous.open(path);
+	matched = 0;
+	diverged = false;
+	sameAsPrevious = false;
+	fd = -1;
+	stream = nullptr;
+	str = nullptr;
+	good = true;
+	// Nothing is created until the output first differs from the file, so
+	// failures to create the temporary file are reported by `close`
+	return good;
+}
+
+bool Writer::close() {
+	flush();
+	if (path.empty())
+		return good;
+	if (good && !diverged && previousExists && matched == previous.size()) {
+		sameAsPrevious = true;
+	} else {
+		if (good && !diverged)
+			diverge(); // Shorter than the previous file, or there was none
+#ifndef _WIN32
+		if (ownsFd) {
+			// The data has to be on disk before the rename makes it the file
+			good = good && ::fsync(fd) == 0;
+			good = ::close(fd) == 0 && good;
+		}
+		ownsFd = false;
+		fd = -1;
+#else
+		file.close();
+		good = good && !file.fail();
+		stream = nullptr;
+#endif
+		if (good)
+			good = std::rename(tmpPath.c_str(), path.c_str()) == 0;
+		if (!good && !tmpPath.empty())
+			std::remove(tmpPath.c_str());
+	}
+	previous.close();
+	path.clear();
+	return good;
+}
+
+void Writer::reserve(size_t bytes) {
+	if (str != nullptr)
+		str->reserve(str->size() + bytes);
+	if (bytes > buffer.size()) {
+		flush();
+		buffer.resize(bytes < BLOCK_SIZE ? bytes : BLOCK_SIZE);
+	}
+}
+
+Writer& Writer::put(const char* s, size_t length) {
+	if (length > buffer.size() - used) {
+		spill();
+		if (length > buffer.size()) {
+			// Too large to be worth copying into the buffer
+			sink(s, length);
+			return *this;
+		}
+	}
+	memcpy(buffer.data() + used, s, length);
+	used += length;
+	return *this;
+}
+
+Writer& Writer::putUnsigned(uint64_t value) {
+	char digits[20];
+	char* end = digits + sizeof(digits);
+	char* begin = end;
+	do {
+		*--begin = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+	return put(begin, end - begin);
+}
+
+Writer& Writer::putSigned(int64_t value) {
+	if (value < 0) {
+		put('-');
+		return putUnsigned(-static_cast<uint64_t>(value));
+	}
+	return putUnsigned(value);
+}
+
+Writer& Writer::putDouble(double value) {
+	char digits[32];
+	int length = snprintf(digits, sizeof(digits), "%g", value);
+	if (length > 0)
+		put(digits, length);
+	return *this;
+}
+
+bool Writer::flush() {
+	spill();
+	if (stream != nullptr)
+		stream->flush();
+	return good;
+}
+
+void Writer::spill() {
+	if (used > 0) {
+		sink(buffer.data(), used);
+		used = 0;
+	}
+}
+
+void Writer::sink(const char* data, size_t length) {
+	if (!path.empty() && !diverged) {
+		if (matched + length <= previous.size()
+				&& memcmp(previous.data() + matched, data, length) == 0) {
+			matched += length;
+			return;
+		}
+		diverge();
+	}
+	emit(data, length);
+}
+
+void Writer::diverge() {
+	diverged = true;
+#ifndef _WIN32
+	// A unique name, so that concurrent runs never share a temporary file
+	std::vector<char> name(path.begin(), path.end());
+	const char suffix[] = ".XXXXXX";
+	name.insert(name.end(), suffix, suffix + sizeof(suffix));
+	fd = mkstemp(name.data());
+	ownsFd = fd >= 0;
+	if (fd >= 0) {
+		tmpPath = name.data();
+		good = good && fchmod(fd, mode) == 0;
+	}
+	good = good && fd >= 0;
+#else
+	file.open(tmpPath, std::ios::binary | std::ios::trunc);
+	stream = &file;
+	good = good && file.good();
+#endif
+	if (good)
+		emit(previous.data(), matched);
+}
+
+void Writer::emit(const char* data, size_t length) {
+	if (str != nullptr) {
+		str->append(data, length);
+		return;
+	}
+	if (stream != nullptr) {
+		stream->write(data, length);
+		good = good && stream->good();
+		return;
+	}
+#ifndef _WIN32
+	while (length > 0 && good) {
+		ssize_t written = ::write(fd, data, length);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			good = false;
+			break;
+		}
+		data += written;
+		length -= written;
+	}
+#endif
+}